@@ -2,10 +2,16 @@
 
 uniform mat4 transform;
 
+// Size of every instance along its own axes.
+uniform vec3 instance_scale;
+
 // Input vertex data, different for all executions of this shader.
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
-layout(location = 3) in mat4 transform_instance;
+
+// Where each instance is and the way it is heading.
+layout(location = 3) in vec3 instance_position;
+layout(location = 4) in vec3 instance_velocity;
 
 // Interpolating vertex attributes over the rasterizer
 out VS_OUT
@@ -16,8 +22,15 @@ out VS_OUT
 
 void main()
 {
-  mat4 final_transform = transform * transform_instance;
-  gl_Position = final_transform * vec4(position, 1);
-  vs_out.position = vec3(transform_instance * vec4(position, 1));
-  vs_out.normal = mat3(transform_instance) * normal;
+  // Face along the velocity with up pointing away from the center. These are the
+  // columns of glm::lookAt(vec3(0), velocity, position), transposed.
+  vec3 forward = normalize(instance_velocity);
+  vec3 right = normalize(cross(forward, instance_position));
+  vec3 up = cross(right, forward);
+  mat3 basis = mat3(right, up, -forward);
+
+  vec3 placed = instance_position + basis * (position * instance_scale);
+  gl_Position = transform * vec4(placed, 1);
+  vs_out.position = placed;
+  vs_out.normal = basis * (normal * instance_scale);
 }
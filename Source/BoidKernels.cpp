@@ -0,0 +1,116 @@
+#include <atomic>
+#include "BoidKernels.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+// Scalar versions, written to match the order of operations of the vector
+// kernels within each lane.
+
+static uint FilterNeighborsScalar(const float * center, float radius_squared, const BoidArrays & boids,
+                                  const uint * candidates, uint count, uint * out)
+{
+    uint added = 0;
+    for (uint i = 0; i < count; ++i)
+    {
+        uint other = candidates[i];
+        float dx = boids.pos_x[other] - center[0];
+        float dy = boids.pos_y[other] - center[1];
+        float dz = boids.pos_z[other] - center[2];
+        float distance_squared = dx * dx + dy * dy + dz * dz;
+        if (distance_squared < radius_squared && distance_squared != 0)
+            out[added++] = other;
+    }
+    return added;
+}
+
+static BehaviorSums AccumulateBehaviorsScalar(const float * position, const BoidArrays & boids,
+                                              const uint * neighbors, uint count)
+{
+    BehaviorSums sums;
+    for (uint i = 0; i < count; ++i)
+    {
+        const PackedBoid & other = boids.packed[neighbors[i]];
+        float offset[3];
+        for (uint axis = 0; axis < 3; ++axis)
+            offset[axis] = position[axis] - other.position[axis];
+        float distance_squared = offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2];
+
+        for (uint axis = 0; axis < 3; ++axis)
+        {
+            // Push away from very close boids.
+            if (distance_squared != 0.f)
+                sums.avoid[axis] += offset[axis] / distance_squared;
+
+            // Head the same way as the flock.
+            sums.align[axis] += other.velocity[axis];
+
+            // Move toward the center of the flock.
+            sums.cohesion[axis] += other.position[axis] - position[axis];
+        }
+    }
+    return sums;
+}
+
+const BoidKernels & GetScalarKernels()
+{
+    static const BoidKernels kernels{FilterNeighborsScalar, AccumulateBehaviorsScalar, "Scalar"};
+    return kernels;
+}
+
+KernelLevel GetSupportedKernelLevel()
+{
+    static const KernelLevel supported = []
+    {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && GetAvx2Kernels())
+            return KernelLevel::AVX2;
+        if (__builtin_cpu_supports("sse4.1") && GetSse41Kernels())
+            return KernelLevel::SSE41;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        int info[4];
+        __cpuid(info, 0);
+        int max_leaf = info[0];
+        __cpuid(info, 1);
+        bool sse41 = (info[2] & (1 << 19)) != 0;
+        bool os_saves_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+                            (_xgetbv(0) & 0x6) == 0x6;
+        bool avx2 = false;
+        if (max_leaf >= 7 && os_saves_avx)
+        {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+        if (avx2 && GetAvx2Kernels())
+            return KernelLevel::AVX2;
+        if (sse41 && GetSse41Kernels())
+            return KernelLevel::SSE41;
+#endif
+        return KernelLevel::Scalar;
+    }();
+    return supported;
+}
+
+static std::atomic<const BoidKernels *> selected_kernels{nullptr};
+
+void SetKernelLevel(KernelLevel level)
+{
+    if (level > GetSupportedKernelLevel())
+        level = GetSupportedKernelLevel();
+
+    const BoidKernels * kernels = &GetScalarKernels();
+    if (level == KernelLevel::AVX2)
+        kernels = GetAvx2Kernels();
+    else if (level == KernelLevel::SSE41)
+        kernels = GetSse41Kernels();
+    selected_kernels = kernels;
+}
+
+const BoidKernels & GetBoidKernels()
+{
+    if (selected_kernels.load() == nullptr)
+        SetKernelLevel(KernelLevel::AVX2);
+    return *selected_kernels.load();
+}
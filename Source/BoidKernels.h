@@ -0,0 +1,81 @@
+#pragma once
+
+// Kept free of glm and Engine/Types.h. The vector kernels include this from files built
+// for instruction sets the CPU might lack, and no code from those files may run before
+// the CPU check, be it a static initializer or an inline function the linker picked.
+typedef unsigned int uint;
+
+// Output buffers passed to FilterNeighbors need this many spare entries
+// past the candidate count, since survivors are stored a full vector at a time.
+const uint KERNEL_PADDING = 8;
+
+// Sums of each flocking behavior over a boid's neighbors, before normalization.
+struct BehaviorSums
+{
+    float avoid[3]{};
+    float align[3]{};
+    float cohesion[3]{};
+};
+
+// A boid's position and velocity side by side, padded to half a cache line, so
+// everything the behavior sums need from a neighbor comes in from one line.
+struct alignas(32) PackedBoid
+{
+    float position[3];
+    float velocity[3];
+    float padding[2];
+};
+
+// Read-only view of the position and velocity arrays of a BoidStorage.
+struct BoidArrays
+{
+    const float * pos_x, * pos_y, * pos_z;
+    const float * vel_x, * vel_y, * vel_z;
+    const PackedBoid * packed;
+};
+
+/*!
+@brief The inner loops of neighbor search and force accumulation,
+   implemented once per instruction set. The widest set the CPU supports
+   is picked at startup.
+*/
+struct BoidKernels
+{
+    /*!
+    @brief Writes each candidate whose squared distance from center is
+       below radius_squared and nonzero to out, keeping their order.
+    @param center Its x, y and z.
+    @param out Room for count + KERNEL_PADDING entries.
+    @return The number of candidates written.
+    */
+    uint (* FilterNeighbors)(const float * center, float radius_squared, const BoidArrays & boids,
+                             const uint * candidates, uint count, uint * out);
+
+    // Accumulates avoid, align, and cohesion sums for the boid at position over its neighbors,
+    // reading each neighbor's packed state once.
+    BehaviorSums (* AccumulateBehaviors)(const float * position, const BoidArrays & boids,
+                                         const uint * neighbors, uint count);
+
+    const char * name;
+};
+
+enum class KernelLevel
+{
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+// The best kernel level this CPU and build support.
+KernelLevel GetSupportedKernelLevel();
+
+// Selects kernels at the given level, or the best supported level below it.
+void SetKernelLevel(KernelLevel level);
+
+// The currently selected kernels. Defaults to the best supported level.
+const BoidKernels & GetBoidKernels();
+
+// Per instruction set implementations. Those not built for this target return nullptr.
+const BoidKernels & GetScalarKernels();
+const BoidKernels * GetSse41Kernels();
+const BoidKernels * GetAvx2Kernels();
@@ -0,0 +1,184 @@
+#include "BoidKernels.h"
+
+// Built with AVX2 enabled for this file only. Only called when the CPU
+// reports support for it.
+#if defined(__AVX2__)
+
+#include <cstdint>
+#include <immintrin.h>
+
+const uint LANES = 8;
+
+// Number of lanes set in each 8 bit mask, and the lane permutations that pack those
+// lanes to the front, stored as bytes and widened on use. Built at compile time, so
+// nothing in this file runs before the CPU check.
+struct LaneTables
+{
+    std::uint8_t counts[1 << LANES];
+    std::uint64_t compress_permutes[1 << LANES];
+};
+
+static constexpr LaneTables MakeLaneTables()
+{
+    LaneTables tables{};
+    for (uint mask = 0; mask < (1 << LANES); ++mask)
+    {
+        std::uint64_t permute = 0;
+        uint next = 0;
+        for (uint lane = 0; lane < LANES; ++lane)
+            if (mask & (1 << lane))
+                permute |= static_cast<std::uint64_t>(lane) << (8 * next++);
+        tables.counts[mask] = static_cast<std::uint8_t>(next);
+        tables.compress_permutes[mask] = permute;
+    }
+    return tables;
+}
+
+static constexpr LaneTables lane_tables = MakeLaneTables();
+
+static inline __m256 Gather(const float * values, __m256i indices)
+{
+    return _mm256_i32gather_ps(values, indices, 4);
+}
+
+// Transposes the packed states of eight boids into vectors of their positions and velocities.
+static inline void TransposeState(const __m256 * rows, __m256 & px, __m256 & py, __m256 & pz, __m256 & vx,
+                                  __m256 & vy, __m256 & vz)
+{
+    // Pair up rows, then pairs of pairs, each 128 bit half holding four rows of two columns.
+    __m256 low01 = _mm256_unpacklo_ps(rows[0], rows[1]);
+    __m256 high01 = _mm256_unpackhi_ps(rows[0], rows[1]);
+    __m256 low23 = _mm256_unpacklo_ps(rows[2], rows[3]);
+    __m256 high23 = _mm256_unpackhi_ps(rows[2], rows[3]);
+    __m256 low45 = _mm256_unpacklo_ps(rows[4], rows[5]);
+    __m256 high45 = _mm256_unpackhi_ps(rows[4], rows[5]);
+    __m256 low67 = _mm256_unpacklo_ps(rows[6], rows[7]);
+    __m256 high67 = _mm256_unpackhi_ps(rows[6], rows[7]);
+
+    // Columns 0 and 4, 1 and 5, 2 and 6, and 3 of the first four rows, and the same for the last four.
+    __m256 columns04 = _mm256_shuffle_ps(low01, low23, 0x44);
+    __m256 columns15 = _mm256_shuffle_ps(low01, low23, 0xEE);
+    __m256 columns26 = _mm256_shuffle_ps(high01, high23, 0x44);
+    __m256 columns37 = _mm256_shuffle_ps(high01, high23, 0xEE);
+    __m256 last_columns04 = _mm256_shuffle_ps(low45, low67, 0x44);
+    __m256 last_columns15 = _mm256_shuffle_ps(low45, low67, 0xEE);
+    __m256 last_columns26 = _mm256_shuffle_ps(high45, high67, 0x44);
+    __m256 last_columns37 = _mm256_shuffle_ps(high45, high67, 0xEE);
+
+    px = _mm256_permute2f128_ps(columns04, last_columns04, 0x20);
+    py = _mm256_permute2f128_ps(columns15, last_columns15, 0x20);
+    pz = _mm256_permute2f128_ps(columns26, last_columns26, 0x20);
+    vx = _mm256_permute2f128_ps(columns37, last_columns37, 0x20);
+    vy = _mm256_permute2f128_ps(columns04, last_columns04, 0x31);
+    vz = _mm256_permute2f128_ps(columns15, last_columns15, 0x31);
+}
+
+static inline float HorizontalSum(__m256 v)
+{
+    __m128 quad = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 pairs = _mm_add_ps(quad, _mm_movehl_ps(quad, quad));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+static uint FilterNeighborsAvx2(const float * center, float radius_squared, const BoidArrays & boids,
+                                const uint * candidates, uint count, uint * out)
+{
+    const __m256 cx = _mm256_set1_ps(center[0]);
+    const __m256 cy = _mm256_set1_ps(center[1]);
+    const __m256 cz = _mm256_set1_ps(center[2]);
+    const __m256 radius = _mm256_set1_ps(radius_squared);
+    const __m256 zero = _mm256_setzero_ps();
+
+    uint added = 0;
+    uint i = 0;
+    for (; i + LANES <= count; i += LANES)
+    {
+        __m256i indices = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(candidates + i));
+        __m256 dx = _mm256_sub_ps(Gather(boids.pos_x, indices), cx);
+        __m256 dy = _mm256_sub_ps(Gather(boids.pos_y, indices), cy);
+        __m256 dz = _mm256_sub_ps(Gather(boids.pos_z, indices), cz);
+        __m256 distance_squared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                                _mm256_mul_ps(dz, dz));
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(distance_squared, radius, _CMP_LT_OQ),
+                                      _mm256_cmp_ps(distance_squared, zero, _CMP_NEQ_UQ));
+        int mask = _mm256_movemask_ps(inside);
+
+        __m256i permute = _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&lane_tables.compress_permutes[mask])));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + added), _mm256_permutevar8x32_epi32(indices, permute));
+        added += lane_tables.counts[mask];
+    }
+
+    return added + GetScalarKernels().FilterNeighbors(center, radius_squared, boids, candidates + i, count - i,
+                                                       out + added);
+}
+
+static BehaviorSums AccumulateBehaviorsAvx2(const float * position, const BoidArrays & boids,
+                                            const uint * neighbors, uint count)
+{
+    const __m256 px = _mm256_set1_ps(position[0]);
+    const __m256 py = _mm256_set1_ps(position[1]);
+    const __m256 pz = _mm256_set1_ps(position[2]);
+    const __m256 zero = _mm256_setzero_ps();
+
+    __m256 avoid_x = zero, avoid_y = zero, avoid_z = zero;
+    __m256 align_x = zero, align_y = zero, align_z = zero;
+    __m256 cohesion_x = zero, cohesion_y = zero, cohesion_z = zero;
+
+    uint i = 0;
+    for (; i + LANES <= count; i += LANES)
+    {
+        // One aligned load per neighbor, its whole state, turned into one vector per component.
+        __m256 rows[LANES];
+        for (uint lane = 0; lane < LANES; ++lane)
+            rows[lane] = _mm256_load_ps(boids.packed[neighbors[i + lane]].position);
+        __m256 qx, qy, qz, vx, vy, vz;
+        TransposeState(rows, qx, qy, qz, vx, vy, vz);
+        __m256 dx = _mm256_sub_ps(px, qx);
+        __m256 dy = _mm256_sub_ps(py, qy);
+        __m256 dz = _mm256_sub_ps(pz, qz);
+        __m256 distance_squared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                                _mm256_mul_ps(dz, dz));
+
+        // Lanes on top of this boid would divide by zero, mask them out.
+        __m256 apart = _mm256_cmp_ps(distance_squared, zero, _CMP_NEQ_UQ);
+        avoid_x = _mm256_add_ps(avoid_x, _mm256_and_ps(apart, _mm256_div_ps(dx, distance_squared)));
+        avoid_y = _mm256_add_ps(avoid_y, _mm256_and_ps(apart, _mm256_div_ps(dy, distance_squared)));
+        avoid_z = _mm256_add_ps(avoid_z, _mm256_and_ps(apart, _mm256_div_ps(dz, distance_squared)));
+
+        align_x = _mm256_add_ps(align_x, vx);
+        align_y = _mm256_add_ps(align_y, vy);
+        align_z = _mm256_add_ps(align_z, vz);
+
+        cohesion_x = _mm256_add_ps(cohesion_x, _mm256_sub_ps(qx, px));
+        cohesion_y = _mm256_add_ps(cohesion_y, _mm256_sub_ps(qy, py));
+        cohesion_z = _mm256_add_ps(cohesion_z, _mm256_sub_ps(qz, pz));
+    }
+
+    BehaviorSums sums = GetScalarKernels().AccumulateBehaviors(position, boids, neighbors + i, count - i);
+    sums.avoid[0] += HorizontalSum(avoid_x);
+    sums.avoid[1] += HorizontalSum(avoid_y);
+    sums.avoid[2] += HorizontalSum(avoid_z);
+    sums.align[0] += HorizontalSum(align_x);
+    sums.align[1] += HorizontalSum(align_y);
+    sums.align[2] += HorizontalSum(align_z);
+    sums.cohesion[0] += HorizontalSum(cohesion_x);
+    sums.cohesion[1] += HorizontalSum(cohesion_y);
+    sums.cohesion[2] += HorizontalSum(cohesion_z);
+    return sums;
+}
+
+const BoidKernels * GetAvx2Kernels()
+{
+    static const BoidKernels kernels{FilterNeighborsAvx2, AccumulateBehaviorsAvx2, "AVX2"};
+    return &kernels;
+}
+
+#else
+
+const BoidKernels * GetAvx2Kernels()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,160 @@
+#include "BoidKernels.h"
+
+// Built with SSE4.1 enabled for this file only. Only called when the CPU
+// reports support for it.
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+
+#include <cstdint>
+#include <smmintrin.h>
+
+const uint LANES = 4;
+
+// Number of lanes set in each 4 bit mask, and the byte shuffles that pack those lanes
+// to the front. Built at compile time, so nothing in this file runs before the CPU check.
+struct LaneTables
+{
+    std::uint8_t counts[1 << LANES];
+    alignas(16) std::uint8_t compress_shuffles[1 << LANES][16];
+};
+
+static constexpr LaneTables MakeLaneTables()
+{
+    LaneTables tables{};
+    for (uint mask = 0; mask < (1 << LANES); ++mask)
+    {
+        uint next = 0;
+        for (uint lane = 0; lane < LANES; ++lane)
+            if (mask & (1 << lane))
+            {
+                for (uint b = 0; b < 4; ++b)
+                    tables.compress_shuffles[mask][next * 4 + b] = static_cast<std::uint8_t>(lane * 4 + b);
+                ++next;
+            }
+        tables.counts[mask] = static_cast<std::uint8_t>(next);
+    }
+    return tables;
+}
+
+static constexpr LaneTables lane_tables = MakeLaneTables();
+
+static inline __m128 Gather(const float * values, const uint * indices)
+{
+    return _mm_setr_ps(values[indices[0]], values[indices[1]], values[indices[2]], values[indices[3]]);
+}
+
+static inline float HorizontalSum(__m128 v)
+{
+    __m128 pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+}
+
+static uint FilterNeighborsSse41(const float * center, float radius_squared, const BoidArrays & boids,
+                                 const uint * candidates, uint count, uint * out)
+{
+    const __m128 cx = _mm_set1_ps(center[0]);
+    const __m128 cy = _mm_set1_ps(center[1]);
+    const __m128 cz = _mm_set1_ps(center[2]);
+    const __m128 radius = _mm_set1_ps(radius_squared);
+    const __m128 zero = _mm_setzero_ps();
+
+    uint added = 0;
+    uint i = 0;
+    for (; i + LANES <= count; i += LANES)
+    {
+        const uint * indices = candidates + i;
+        __m128 dx = _mm_sub_ps(Gather(boids.pos_x, indices), cx);
+        __m128 dy = _mm_sub_ps(Gather(boids.pos_y, indices), cy);
+        __m128 dz = _mm_sub_ps(Gather(boids.pos_z, indices), cz);
+        __m128 distance_squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                                             _mm_mul_ps(dz, dz));
+        __m128 inside = _mm_and_ps(_mm_cmplt_ps(distance_squared, radius),
+                                   _mm_cmpneq_ps(distance_squared, zero));
+        int mask = _mm_movemask_ps(inside);
+
+        __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i *>(lane_tables.compress_shuffles[mask]));
+        __m128i packed = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(indices)), shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + added), packed);
+        added += lane_tables.counts[mask];
+    }
+
+    return added + GetScalarKernels().FilterNeighbors(center, radius_squared, boids, candidates + i, count - i,
+                                                       out + added);
+}
+
+static BehaviorSums AccumulateBehaviorsSse41(const float * position, const BoidArrays & boids,
+                                             const uint * neighbors, uint count)
+{
+    const __m128 px = _mm_set1_ps(position[0]);
+    const __m128 py = _mm_set1_ps(position[1]);
+    const __m128 pz = _mm_set1_ps(position[2]);
+    const __m128 zero = _mm_setzero_ps();
+
+    __m128 avoid_x = zero, avoid_y = zero, avoid_z = zero;
+    __m128 align_x = zero, align_y = zero, align_z = zero;
+    __m128 cohesion_x = zero, cohesion_y = zero, cohesion_z = zero;
+
+    uint i = 0;
+    for (; i + LANES <= count; i += LANES)
+    {
+        // Each neighbor's state is two aligned loads, turned into one vector per component.
+        const PackedBoid * others[LANES];
+        for (uint lane = 0; lane < LANES; ++lane)
+            others[lane] = boids.packed + neighbors[i + lane];
+        __m128 qx = _mm_load_ps(others[0]->position);
+        __m128 qy = _mm_load_ps(others[1]->position);
+        __m128 qz = _mm_load_ps(others[2]->position);
+        __m128 vx = _mm_load_ps(others[3]->position);
+        _MM_TRANSPOSE4_PS(qx, qy, qz, vx);
+        __m128 vy = _mm_load_ps(&others[0]->velocity[1]);
+        __m128 vz = _mm_load_ps(&others[1]->velocity[1]);
+        __m128 unused_a = _mm_load_ps(&others[2]->velocity[1]);
+        __m128 unused_b = _mm_load_ps(&others[3]->velocity[1]);
+        _MM_TRANSPOSE4_PS(vy, vz, unused_a, unused_b);
+        __m128 dx = _mm_sub_ps(px, qx);
+        __m128 dy = _mm_sub_ps(py, qy);
+        __m128 dz = _mm_sub_ps(pz, qz);
+        __m128 distance_squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                                             _mm_mul_ps(dz, dz));
+
+        // Lanes on top of this boid would divide by zero, mask them out.
+        __m128 apart = _mm_cmpneq_ps(distance_squared, zero);
+        avoid_x = _mm_add_ps(avoid_x, _mm_and_ps(apart, _mm_div_ps(dx, distance_squared)));
+        avoid_y = _mm_add_ps(avoid_y, _mm_and_ps(apart, _mm_div_ps(dy, distance_squared)));
+        avoid_z = _mm_add_ps(avoid_z, _mm_and_ps(apart, _mm_div_ps(dz, distance_squared)));
+
+        align_x = _mm_add_ps(align_x, vx);
+        align_y = _mm_add_ps(align_y, vy);
+        align_z = _mm_add_ps(align_z, vz);
+
+        cohesion_x = _mm_add_ps(cohesion_x, _mm_sub_ps(qx, px));
+        cohesion_y = _mm_add_ps(cohesion_y, _mm_sub_ps(qy, py));
+        cohesion_z = _mm_add_ps(cohesion_z, _mm_sub_ps(qz, pz));
+    }
+
+    BehaviorSums sums = GetScalarKernels().AccumulateBehaviors(position, boids, neighbors + i, count - i);
+    sums.avoid[0] += HorizontalSum(avoid_x);
+    sums.avoid[1] += HorizontalSum(avoid_y);
+    sums.avoid[2] += HorizontalSum(avoid_z);
+    sums.align[0] += HorizontalSum(align_x);
+    sums.align[1] += HorizontalSum(align_y);
+    sums.align[2] += HorizontalSum(align_z);
+    sums.cohesion[0] += HorizontalSum(cohesion_x);
+    sums.cohesion[1] += HorizontalSum(cohesion_y);
+    sums.cohesion[2] += HorizontalSum(cohesion_z);
+    return sums;
+}
+
+const BoidKernels * GetSse41Kernels()
+{
+    static const BoidKernels kernels{FilterNeighborsSse41, AccumulateBehaviorsSse41, "SSE4.1"};
+    return &kernels;
+}
+
+#else
+
+const BoidKernels * GetSse41Kernels()
+{
+    return nullptr;
+}
+
+#endif
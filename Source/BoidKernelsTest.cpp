@@ -0,0 +1,204 @@
+// Checks the vector kernels against the scalar ones on random boids. Neighbor
+// filtering must match exactly. Behavior sums add their terms in a different
+// order, so they must match to within SUM_TOLERANCE of the summed magnitudes.
+// Kernel levels this CPU doesn't support are skipped.
+// Usage:
+//   boids_kernel_test [--seed S]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "BoidKernels.h"
+
+static const uint NUM_BOIDS = 2048;
+static const uint NUM_QUERIES = 2000;
+// Longest candidate list, lengths run through every remainder of 4 and 8.
+static const uint MAX_CANDIDATES = 203;
+static const float RADIUS_SQUARED = 4;
+// Boids spawn in a cube this far from the origin on each axis.
+static const float SPREAD = 3;
+
+// Largest difference allowed in a behavior sum, relative to the sum of the
+// magnitudes of its terms, so cancelling terms don't make it meaningless.
+static const double SUM_TOLERANCE = 1e-5;
+
+struct TestBoids
+{
+    std::vector<float> pos_x, pos_y, pos_z;
+    std::vector<float> vel_x, vel_y, vel_z;
+    std::vector<PackedBoid> packed;
+
+    BoidArrays Arrays() const
+    {
+        return BoidArrays{pos_x.data(), pos_y.data(), pos_z.data(), vel_x.data(), vel_y.data(), vel_z.data(),
+                          packed.data()};
+    }
+};
+
+static TestBoids MakeBoids(std::mt19937 & random)
+{
+    std::uniform_real_distribution<float> coordinate(-SPREAD, SPREAD);
+    TestBoids boids;
+    boids.packed.resize(NUM_BOIDS);
+    for (uint boid = 0; boid < NUM_BOIDS; ++boid)
+    {
+        // Every eighth boid sits on top of another, for neighbors at distance 0.
+        float position[3], velocity[3];
+        for (uint axis = 0; axis < 3; ++axis)
+        {
+            position[axis] = coordinate(random);
+            velocity[axis] = coordinate(random);
+        }
+        if (boid % 8 == 7)
+            std::memcpy(position, boids.packed[boid - 1].position, sizeof(position));
+
+        boids.pos_x.emplace_back(position[0]);
+        boids.pos_y.emplace_back(position[1]);
+        boids.pos_z.emplace_back(position[2]);
+        boids.vel_x.emplace_back(velocity[0]);
+        boids.vel_y.emplace_back(velocity[1]);
+        boids.vel_z.emplace_back(velocity[2]);
+        std::memcpy(boids.packed[boid].position, position, sizeof(position));
+        std::memcpy(boids.packed[boid].velocity, velocity, sizeof(velocity));
+    }
+    return boids;
+}
+
+// Sums of the magnitudes of the terms behind each behavior sum, in doubles.
+static BehaviorSums SumMagnitudes(const float * position, const TestBoids & boids, const uint * neighbors,
+                                  uint count)
+{
+    double avoid[3] = {}, align[3] = {}, cohesion[3] = {};
+    for (uint i = 0; i < count; ++i)
+    {
+        const PackedBoid & other = boids.packed[neighbors[i]];
+        double offset[3];
+        for (uint axis = 0; axis < 3; ++axis)
+            offset[axis] = static_cast<double>(position[axis]) - other.position[axis];
+        double distance_squared = offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2];
+        for (uint axis = 0; axis < 3; ++axis)
+        {
+            if (distance_squared != 0)
+                avoid[axis] += std::fabs(offset[axis]) / distance_squared;
+            align[axis] += std::fabs(other.velocity[axis]);
+            cohesion[axis] += std::fabs(offset[axis]);
+        }
+    }
+
+    BehaviorSums magnitudes;
+    for (uint axis = 0; axis < 3; ++axis)
+    {
+        magnitudes.avoid[axis] = static_cast<float>(avoid[axis]);
+        magnitudes.align[axis] = static_cast<float>(align[axis]);
+        magnitudes.cohesion[axis] = static_cast<float>(cohesion[axis]);
+    }
+    return magnitudes;
+}
+
+// Largest difference between the components of a sum and the expected ones, relative to their magnitudes.
+static double CompareSum(const float * sum, const float * expected, const float * magnitude)
+{
+    double worst = 0;
+    for (uint axis = 0; axis < 3; ++axis)
+    {
+        double difference = std::fabs(static_cast<double>(sum[axis]) - expected[axis]);
+        double scale = magnitude[axis] > 0 ? magnitude[axis] : 1;
+        if (difference / scale > worst)
+            worst = difference / scale;
+    }
+    return worst;
+}
+
+// Runs every query through kernels and the scalar kernels. Returns the number of failures.
+static uint TestKernels(const BoidKernels & kernels, const TestBoids & boids, std::uint32_t seed)
+{
+    const BoidKernels & scalar = GetScalarKernels();
+    BoidArrays arrays = boids.Arrays();
+    std::mt19937 random(seed);
+
+    uint failures = 0;
+    double worst_sum = 0;
+    std::vector<uint> candidates, expected, filtered;
+    for (uint query = 0; query < NUM_QUERIES; ++query)
+    {
+        // Queries centered on a boid, so the candidates include one at distance 0.
+        uint center_boid = random() % NUM_BOIDS;
+        const float * center = boids.packed[center_boid].position;
+        uint count = query % (MAX_CANDIDATES + 1);
+        candidates.resize(count);
+        for (uint i = 0; i < count; ++i)
+            candidates[i] = i % 16 == 0 ? center_boid : random() % NUM_BOIDS;
+
+        expected.assign(count + KERNEL_PADDING, 0);
+        filtered.assign(count + KERNEL_PADDING, 0);
+        uint num_expected = scalar.FilterNeighbors(center, RADIUS_SQUARED, arrays, candidates.data(), count,
+                                                   expected.data());
+        uint num_filtered = kernels.FilterNeighbors(center, RADIUS_SQUARED, arrays, candidates.data(), count,
+                                                    filtered.data());
+        if (num_filtered != num_expected ||
+            !std::equal(expected.begin(), expected.begin() + num_expected, filtered.begin()))
+        {
+            std::printf("%s: FilterNeighbors differs from scalar on query %u (%u candidates)\n", kernels.name,
+                        query, count);
+            ++failures;
+        }
+
+        // Sum over the raw candidates too, so zero distances reach the sum kernels.
+        for (const std::vector<uint> * neighbors : {&expected, &candidates})
+        {
+            uint num_neighbors = neighbors == &expected ? num_expected : count;
+            BehaviorSums want = scalar.AccumulateBehaviors(center, arrays, neighbors->data(), num_neighbors);
+            BehaviorSums got = kernels.AccumulateBehaviors(center, arrays, neighbors->data(), num_neighbors);
+            BehaviorSums magnitudes = SumMagnitudes(center, boids, neighbors->data(), num_neighbors);
+            double difference = std::max({CompareSum(got.avoid, want.avoid, magnitudes.avoid),
+                                          CompareSum(got.align, want.align, magnitudes.align),
+                                          CompareSum(got.cohesion, want.cohesion, magnitudes.cohesion)});
+            if (!(difference <= SUM_TOLERANCE))
+            {
+                std::printf("%s: AccumulateBehaviors differs from scalar by %g on query %u (%u neighbors)\n",
+                            kernels.name, difference, query, num_neighbors);
+                ++failures;
+            }
+            worst_sum = std::max(worst_sum, difference);
+        }
+    }
+    std::printf("%s: %u failures, largest behavior sum difference %g\n", kernels.name, failures, worst_sum);
+    return failures;
+}
+
+int main(int argc, char ** argv)
+{
+    std::uint32_t seed = 1;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc)
+            seed = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else
+        {
+            std::fprintf(stderr, "Unknown argument: %s\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    std::mt19937 random(seed);
+    TestBoids boids = MakeBoids(random);
+
+    uint failures = 0;
+    KernelLevel supported = GetSupportedKernelLevel();
+    if (supported >= KernelLevel::SSE41)
+        failures += TestKernels(*GetSse41Kernels(), boids, seed);
+    else
+        std::printf("SSE4.1: not supported, skipped\n");
+    if (supported >= KernelLevel::AVX2)
+        failures += TestKernels(*GetAvx2Kernels(), boids, seed);
+    else
+        std::printf("AVX2: not supported, skipped\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,1086 @@
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/norm.hpp>
+#include "BoidSim.h"
+#include "Morton.h"
+#include "BoidKernels.h"
+#include "Engine/Random.h"
+#include "Engine/ThreadPool.h"
+#include "Engine/Trace.h"
+
+// Boids per task handed to the thread pool in each phase.
+static const uint POPULATE_CHUNK_SIZE = 64;
+static const uint FORCE_CHUNK_SIZE = 256;
+static const uint MOVE_CHUNK_SIZE = 1024;
+static const uint SPAWN_CHUNK_SIZE = 4096;
+static const uint INSTANCE_CHUNK_SIZE = 4096;
+static const uint VERLET_SCAN_CHUNK_SIZE = 4096;
+static const uint LOD_SCAN_CHUNK_SIZE = 4096;
+
+// Boids take their level of detail turns in runs this long, so boids updated together sit together in memory.
+static const uint LOD_TURN_RUN = 64;
+
+// How far a boid can poke out of the view frustum and still be in sight, as boids aren't points.
+static const float LOD_FRUSTUM_MARGIN = 2;
+
+// Narrowest Verlet skin allowed, so the drift it is measured against stays finite.
+static const float MIN_VERLET_SKIN = 0.01f;
+
+// Random values each spawned boid takes from the spawn stream, padded to whole Philox blocks.
+static const uint SPAWN_VALUES_PER_BOID = 8;
+
+using Clock = std::chrono::steady_clock;
+
+// Milliseconds from start until now, restarting start for the next phase.
+// The phase is also recorded as a trace zone if a trace is being captured.
+static double Lap(Clock::time_point & start, const char * trace_name)
+{
+    PE::Tracer::GetInstance().Record(trace_name, start);
+    Clock::time_point now = Clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - start).count();
+    start = now;
+    return ms;
+}
+
+BoidSim::BoidSim()
+{
+    static std::atomic<std::uint64_t> next_spawn_stream{0};
+    SpawnStream = next_spawn_stream++;
+}
+
+void BoidSim::AddBoids(uint num)
+{
+    uint first = Boids.Size();
+    Boids.Resize(first + num);
+    Neighbors.Resize(first + num);
+    for (auto & fear_neighbors : FearNeighbors)
+        fear_neighbors.Resize(first + num);
+    
+    // Every boid takes a fixed range of the spawn stream, so the result only
+    // depends on the seed, not on how the work is split between threads.
+    std::uint64_t seed = PE::GetRandomSeed();
+    std::uint64_t first_serial = spawned_boids;
+    for (uint i = 0; i < num; ++i)
+        Handles.Add();
+    PE::ThreadPool::GetInstance().ParallelFor(num, SPAWN_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        PE::RandomStream stream(seed, SpawnStream);
+        stream.Seek((first_serial + begin) * SPAWN_VALUES_PER_BOID);
+        std::vector<float> random((end - begin) * SPAWN_VALUES_PER_BOID);
+        stream.Fill(random.data(), random.size(), -1, 1);
+        for (uint i = begin; i < end; ++i)
+            MakeBoid(first + i, &random[(i - begin) * SPAWN_VALUES_PER_BOID]);
+    });
+    spawned_boids += num;
+    
+    // File only the new boids. Their neighbor lists fill in over the next ticks,
+    // ahead of the regular round of repopulating.
+    PositionGrid->Insert(Boids.GridCells(), first, num);
+    RescaleBudgets(first, Boids.Size());
+    
+    if (neighbor_mode == NeighborMode::Verlet)
+    {
+        std::vector<uint> arrivals(num);
+        std::iota(arrivals.begin(), arrivals.end(), first);
+        ExpireListsNear(arrivals);
+    }
+}
+
+void BoidSim::RemoveBoids(uint num)
+{
+    // Taking boids off the end moves nobody else.
+    uint old_size = Boids.Size();
+    uint old_epoch = Handles.GetEpoch();
+    for (uint i = 0; i < std::min(num, old_size); ++i)
+        SwapRemove(Boids.Size() - 1);
+    FinishRemoval(old_size, old_epoch);
+}
+
+void BoidSim::RemoveBoids(const std::vector<BoidHandle> & handles)
+{
+    uint old_size = Boids.Size();
+    uint old_epoch = Handles.GetEpoch();
+    for (BoidHandle handle : handles)
+    {
+        uint boid = Handles.Find(handle);
+        if (boid != NO_BOID)
+            SwapRemove(boid);
+    }
+    FinishRemoval(old_size, old_epoch);
+}
+
+void BoidSim::SwapRemove(uint boid)
+{
+    // Fill the hole with the last boid to keep every array dense. Neighbor lists naming
+    // either index aren't searched for here, the slot map's epochs catch them when read.
+    uint last = Boids.Size() - 1;
+    Handles.SwapRemove(boid);
+    PositionGrid->SwapRemove(boid, Boids.GetGridCell(boid));
+    if (boid != last)
+    {
+        removal_holes.emplace_back(boid);
+        Boids.Move(last, boid);
+        Neighbors.MoveRow(last, boid);
+        for (auto & fear_neighbors : FearNeighbors)
+            fear_neighbors.MoveRow(last, boid);
+    }
+    Boids.Resize(last);
+    Neighbors.Resize(last);
+    for (auto & fear_neighbors : FearNeighbors)
+        fear_neighbors.Resize(last);
+}
+
+void BoidSim::FinishRemoval(uint old_size, uint old_epoch)
+{
+    // Boids moved into a hole drop out of lists that knew them by their old index. A hole
+    // may since have been emptied again, or refilled by a later removal in the same batch.
+    if (neighbor_mode == NeighborMode::Verlet)
+    {
+        std::vector<uint> arrivals;
+        for (uint hole : removal_holes)
+            if (hole < Boids.Size() && !Handles.SameBoid(hole, old_epoch))
+                arrivals.emplace_back(hole);
+        std::sort(arrivals.begin(), arrivals.end());
+        arrivals.erase(std::unique(arrivals.begin(), arrivals.end()), arrivals.end());
+        ExpireListsNear(arrivals);
+    }
+    removal_holes.clear();
+    
+    if (Boids.Empty())
+    {
+        Neighbors.Clear();
+        for (auto & fear_neighbors : FearNeighbors)
+            fear_neighbors.Clear();
+        PositionGrid->Clear();
+    }
+    
+    unpopulated_first = std::min(unpopulated_first, Boids.Size());
+    RescaleBudgets(old_size, Boids.Size());
+}
+
+void BoidSim::RescaleBudgets(uint old_size, uint new_size)
+{
+    // Keep every boid refreshed as often as before, so budgets tuned for the old count
+    // carry over. A new group starts from the default shares. Every budget covers at
+    // least one boid, or small groups would never find their neighbors.
+    SimBudgets defaults = BudgetScheduler::DefaultBudgets(new_size);
+    auto rescale = [&](uint budget, uint default_budget)
+    {
+        double scaled = old_size ? std::round(double(budget) * new_size / old_size) : double(default_budget);
+        return std::max(1u, static_cast<uint>(scaled));
+    };
+    updates_per_frame = rescale(updates_per_frame, defaults.updates);
+    grid_updates_per_frame = rescale(grid_updates_per_frame, defaults.grid_updates);
+    populates_per_frame = rescale(populates_per_frame, defaults.populates);
+}
+
+void BoidSim::Update(float dt)
+{
+    if (Boids.Empty())
+        return;
+    
+    PE::TraceZone zone("BoidSim::Update");
+    Clock::time_point phase_start = Clock::now();
+    ++tick;
+    
+    SyncFearedOrder();
+    UpdateMortonOrder();
+    phase_times.reorder = Lap(phase_start, "Reorder");
+    
+    counters = SimCounters{};
+    
+    // The tree covers every boid whichever of them are due, so it's timed apart from the populates.
+    bool nearest = neighbor_mode == NeighborMode::KNearest;
+    phase_times.tree = 0;
+    if (nearest)
+    {
+        NearestTree.Build(Boids);
+        phase_times.tree = Lap(phase_start, "BuildNearestTree");
+    }
+    
+    PE::ThreadPool & pool = PE::ThreadPool::GetInstance();
+    uint num_boids = Boids.Size();
+    
+    // Each phase only writes state belonging to the boid being processed, and only reads
+    // state no other task in that phase writes, so no phase depends on how it's split.
+    
+    // Level of detail picks which boids are due this tick in place of the round robin.
+    bool lod = LodDistance > 0 && has_view;
+    if (lod)
+        FindDueLodBoids(num_boids);
+    else
+        lod_stats = SimLodStats{};
+    
+    // Gather neighbor lists in parallel into per-chunk staging, then commit them in order.
+    SelectPopulates(num_boids);
+    uint populates = static_cast<uint>(populate_order.size());
+    uint populate_chunks = (populates + POPULATE_CHUNK_SIZE - 1) / POPULATE_CHUNK_SIZE;
+    if (PopulateChunks.size() < populate_chunks)
+        PopulateChunks.resize(populate_chunks);
+    pool.ParallelFor(populates, POPULATE_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        PopulateChunk & chunk = PopulateChunks[begin / POPULATE_CHUNK_SIZE];
+        chunk.boids.clear();
+        chunk.neighbors.clear();
+        chunk.neighbor_counts.clear();
+        chunk.cells_scanned = 0;
+        chunk.candidates_checked = 0;
+        chunk.fear_neighbors.resize(FearedBoids.size());
+        chunk.fear_counts.resize(FearedBoids.size());
+        for (uint feared_group = 0; feared_group < FearedBoids.size(); ++feared_group)
+        {
+            chunk.fear_neighbors[feared_group].clear();
+            chunk.fear_counts[feared_group].clear();
+        }
+        
+        // Nearest neighbors are looked up as a batch, the boids in a chunk are often close together.
+        if (nearest)
+            chunk.candidates_checked += NearestTree.FindNearest(&populate_order[begin], end - begin,
+                                                                neighbor_count, chunk.neighbors,
+                                                                chunk.neighbor_counts);
+        for (uint i = begin; i < end; ++i)
+            PopulateNeighbors(populate_order[i], chunk);
+    });
+    for (uint chunk = 0; chunk < populate_chunks; ++chunk)
+        CommitNeighbors(PopulateChunks[chunk]);
+    phase_times.populate = Lap(phase_start, "PopulateNeighbors");
+    
+    // Without level of detail the boids due a force update are the next run of the round robin.
+    uint updates = std::min(updates_per_frame, num_boids);
+    if (!lod)
+    {
+        update_order.clear();
+        for (uint i = 1; i <= updates; ++i)
+            update_order.emplace_back((updates_counter + i) % num_boids);
+    }
+    uint forces = static_cast<uint>(update_order.size());
+    
+    // The octree is rebuilt whichever boids are due, so it's timed apart from the force updates.
+    phase_times.long_range = 0;
+    if (LongRangeDistance > 0)
+    {
+        FlockTree.Build(Boids);
+        FlockTree.Gather(LongRangeDistance, OpeningAngle, update_order.data(), forces);
+        phase_times.long_range = Lap(phase_start, "GatherLongRange");
+    }
+    
+    // Each force update writes only its own boid's force.
+    pool.ParallelFor(forces, FORCE_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        std::vector<uint> scratch, in_range;
+        for (uint i = begin; i < end; ++i)
+            UpdateForce(update_order[i], scratch, in_range);
+    });
+    updates_counter = (updates_counter + updates) % num_boids;
+    phase_times.force = Lap(phase_start, "UpdateForce");
+    
+    // Forces are all final before anything moves. Verlet lists also need the longest step taken.
+    bool track_travel = neighbor_mode == NeighborMode::Verlet;
+    MoveSteps.assign((num_boids + MOVE_CHUNK_SIZE - 1) / MOVE_CHUNK_SIZE, 0.f);
+    pool.ParallelFor(num_boids, MOVE_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        if (!track_travel)
+        {
+            for (uint i = begin; i < end; ++i)
+                MoveBoid(i, dt);
+            return;
+        }
+        
+        float step_squared = 0;
+        for (uint i = begin; i < end; ++i)
+        {
+            PE::Vec3 start = Boids.GetPosition(i);
+            MoveBoid(i, dt);
+            step_squared = std::max(step_squared, glm::distance2(start, Boids.GetPosition(i)));
+        }
+        MoveSteps[begin / MOVE_CHUNK_SIZE] = step_squared;
+    });
+    if (track_travel)
+        travel += std::sqrt(*std::max_element(MoveSteps.begin(), MoveSteps.end()));
+    phase_times.move = Lap(phase_start, "MoveBoid");
+    
+    // Verlet lists are gathered from every boid's current cell, so every boid is refiled each tick.
+    uint grid_updates = track_travel ? num_boids : grid_updates_per_frame;
+    for (uint i = 0; i < grid_updates; ++i)
+    {
+        grid_updates_counter = (grid_updates_counter + 1) % Boids.Size();
+        UpdateGridPosition(grid_updates_counter);
+    }
+    phase_times.grid = Lap(phase_start, "UpdateGridPosition");
+    
+    if (Scheduler.Enabled())
+    {
+        // Level of detail covers only part of each budget, so costs are learned per budgeted
+        // boid, the unit the next budgets are planned in. Verlet lists are gathered as they fall due.
+        if (lod && !track_travel)
+            populates = std::min(populates_per_frame, num_boids);
+        SimBudgets next = Scheduler.Plan(phase_times, SimBudgets{updates, grid_updates, populates}, num_boids,
+                                         dt);
+        updates_per_frame = next.updates;
+        grid_updates_per_frame = next.grid_updates;
+        populates_per_frame = next.populates;
+    }
+}
+
+void BoidSim::PopulateGrid()
+{
+    for (uint i = 0; i < Boids.Size(); ++i)
+        Boids.SetGridCell(i, PositionGrid->GetKey(Boids.GetPosition(i)));
+    
+    PositionGrid->Build(Boids.GridCells(), Boids.Size());
+}
+
+void BoidSim::ExpireListsNear(const std::vector<uint> & arrivals)
+{
+    // A boid turning up at an index, spawned or moved there by a removal, is missing from
+    // the lists gathered before. It's treated as if it had sat where it is now all along:
+    // any list whose boid was within reach of that spot when gathered would have found it,
+    // so those lists are due. Their boids have moved at most a skin since, which bounds the search.
+    float reach = std::sqrt(gather_dist_squared);
+    uint search_distance = static_cast<uint>(std::ceil((reach + verlet_skin) / PositionGrid->GetCellSize()));
+    std::vector<IndexSpan> cells;
+    for (uint arrival : arrivals)
+    {
+        PE::Vec3 position = Boids.GetPosition(arrival);
+        cells.clear();
+        PositionGrid->GatherCells(position, search_distance, cells);
+        for (const IndexSpan & cell : cells)
+            for (uint boid : cell)
+                if (boid != arrival && glm::distance2(Boids.GetListPosition(boid), position) <= gather_dist_squared)
+                    Boids.ExpireList(boid);
+    }
+}
+
+void BoidSim::SelectPopulates(uint num_boids)
+{
+    populate_order.clear();
+    if (neighbor_mode == NeighborMode::Verlet)
+    {
+        // Boids that were never gathered are always due, so none are left waiting.
+        FindDueVerletLists(num_boids);
+        unpopulated_first = num_boids;
+        return;
+    }
+    staleness = SimStaleness{};
+    
+    // Boids added since the last pass have no neighbors yet, so they go first.
+    uint populates = std::min(populates_per_frame, num_boids);
+    uint fresh = std::min(num_boids - unpopulated_first, populates);
+    for (uint i = 0; i < fresh; ++i)
+        populate_order.emplace_back(unpopulated_first + i);
+    unpopulated_first += fresh;
+    
+    if (LodDistance > 0 && has_view)
+    {
+        // Under level of detail, the boids whose turn it is follow them.
+        uint scan_chunks = (num_boids + LOD_SCAN_CHUNK_SIZE - 1) / LOD_SCAN_CHUNK_SIZE;
+        for (uint chunk = 0; chunk < scan_chunks; ++chunk)
+        {
+            const LodScanChunk & scan = LodScanChunks[chunk];
+            populate_order.insert(populate_order.end(), scan.populates.begin(), scan.populates.end());
+        }
+        return;
+    }
+    
+    for (uint i = fresh; i < populates; ++i)
+    {
+        populates_counter = (populates_counter + 1) % num_boids;
+        populate_order.emplace_back(populates_counter);
+    }
+}
+
+void BoidSim::FindDueVerletLists(uint num_boids)
+{
+    // A boid outside a list, more than the skin past the neighbor distance when it was gathered,
+    // can only have come within range by the two closing the skin between them. The list's own
+    // boid has moved as far as its position says, and the other at most as far as travel has
+    // grown since, so the list is due once the two add up to the skin. A boid flying straight
+    // at the top speed uses up half the skin each side, slower or turning ones last longer.
+    uint scan_chunks = (num_boids + VERLET_SCAN_CHUNK_SIZE - 1) / VERLET_SCAN_CHUNK_SIZE;
+    if (VerletScanChunks.size() < scan_chunks)
+        VerletScanChunks.resize(scan_chunks);
+    PE::ThreadPool::GetInstance().ParallelFor(num_boids, VERLET_SCAN_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        VerletScanChunk & chunk = VerletScanChunks[begin / VERLET_SCAN_CHUNK_SIZE];
+        chunk.due.clear();
+        chunk.max_age = 0;
+        chunk.age_sum = 0;
+        chunk.max_drift = 0;
+        for (uint boid = begin; boid < end; ++boid)
+        {
+            double list_travel = Boids.GetListTravel(boid);
+            if (verlet_lists_stale || list_travel == NEVER_GATHERED)
+            {
+                chunk.due.emplace_back(boid);
+                continue;
+            }
+            
+            uint age = tick - Boids.GetListTick(boid);
+            double moved = glm::distance(Boids.GetPosition(boid), Boids.GetListPosition(boid));
+            float drift = static_cast<float>((moved + travel - list_travel) / verlet_skin);
+            chunk.max_age = std::max(chunk.max_age, age);
+            chunk.age_sum += age;
+            chunk.max_drift = std::max(chunk.max_drift, drift);
+            if (drift > 1)
+                chunk.due.emplace_back(boid);
+        }
+    });
+    
+    staleness = SimStaleness{};
+    std::uint64_t age_sum = 0;
+    for (uint chunk = 0; chunk < scan_chunks; ++chunk)
+    {
+        const VerletScanChunk & scan = VerletScanChunks[chunk];
+        populate_order.insert(populate_order.end(), scan.due.begin(), scan.due.end());
+        staleness.max_age = std::max(staleness.max_age, scan.max_age);
+        staleness.max_drift = std::max(staleness.max_drift, scan.max_drift);
+        age_sum += scan.age_sum;
+    }
+    staleness.mean_age = static_cast<double>(age_sum) / num_boids;
+    verlet_lists_stale = false;
+}
+
+void BoidSim::FindDueLodBoids(uint num_boids)
+{
+    // The budgets set how many ticks apart each boid's turns are at full detail, and each tier
+    // doubles that. Turns are staggered across runs of boids so every tick does a similar share.
+    uint last_tier = std::clamp(LodTiers, 1u, MAX_LOD_TIERS) - 1;
+    uint update_interval = (num_boids + std::max(updates_per_frame, 1u) - 1) / std::max(updates_per_frame, 1u);
+    uint populate_interval = (num_boids + std::max(populates_per_frame, 1u) - 1) /
+                             std::max(populates_per_frame, 1u);
+    
+    // Verlet lists are gathered as they fall due, and new boids wait for SelectPopulates, not their turn.
+    bool find_populates = neighbor_mode != NeighborMode::Verlet;
+    
+    // Squared distance past which a boid drops each further tier.
+    float reach_squared[MAX_LOD_TIERS];
+    for (uint tier = 0; tier < last_tier; ++tier)
+        reach_squared[tier] = LodDistance * LodDistance * static_cast<float>(1u << (2 * tier));
+    
+    uint scan_chunks = (num_boids + LOD_SCAN_CHUNK_SIZE - 1) / LOD_SCAN_CHUNK_SIZE;
+    if (LodScanChunks.size() < scan_chunks)
+        LodScanChunks.resize(scan_chunks);
+    PE::ThreadPool::GetInstance().ParallelFor(num_boids, LOD_SCAN_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        LodScanChunk & chunk = LodScanChunks[begin / LOD_SCAN_CHUNK_SIZE];
+        chunk.updates.clear();
+        chunk.populates.clear();
+        chunk.stats = SimLodStats{};
+        
+        // Copied out so the compiler knows the lists growing below don't change them.
+        PE::Vec3 camera = lod_view.position;
+        PE::Vec4 planes[6];
+        std::copy(frustum_planes, frustum_planes + 6, planes);
+        const float * x = Boids.PositionX();
+        const float * y = Boids.PositionY();
+        const float * z = Boids.PositionZ();
+        for (uint run = begin; run < end; run += LOD_TURN_RUN)
+        {
+            // Which tiers have a turn this tick only changes from one run of boids to the next.
+            uint turn = tick + run / LOD_TURN_RUN;
+            uint update_tiers = 0, populate_tiers = 0;
+            for (uint tier = 0; tier <= last_tier; ++tier)
+            {
+                update_tiers |= (turn % (update_interval << tier) == 0) << tier;
+                populate_tiers |= (turn % (populate_interval << tier) == 0) << tier;
+            }
+            
+            uint run_end = std::min(run + LOD_TURN_RUN, end);
+            for (uint boid = run; boid < run_end; ++boid)
+            {
+                float dx = x[boid] - camera.x;
+                float dy = y[boid] - camera.y;
+                float dz = z[boid] - camera.z;
+                float distance_squared = dx * dx + dy * dy + dz * dz;
+                uint tier = 0;
+                for (uint further = 0; further < last_tier; ++further)
+                    tier += distance_squared >= reach_squared[further];
+                
+                bool in_sight = true;
+                for (const PE::Vec4 & plane : planes)
+                    in_sight &= plane.x * x[boid] + plane.y * y[boid] + plane.z * z[boid] + plane.w >=
+                                -LOD_FRUSTUM_MARGIN;
+                tier = in_sight ? tier : last_tier;
+                chunk.stats.out_of_sight += !in_sight;
+                ++chunk.stats.tiers[tier];
+                
+                if (update_tiers >> tier & 1)
+                    chunk.updates.emplace_back(boid);
+                if (find_populates && boid < unpopulated_first && populate_tiers >> tier & 1)
+                    chunk.populates.emplace_back(boid);
+            }
+        }
+    });
+    
+    lod_stats = SimLodStats{};
+    update_order.clear();
+    for (uint chunk = 0; chunk < scan_chunks; ++chunk)
+    {
+        const LodScanChunk & scan = LodScanChunks[chunk];
+        update_order.insert(update_order.end(), scan.updates.begin(), scan.updates.end());
+        for (uint tier = 0; tier <= last_tier; ++tier)
+            lod_stats.tiers[tier] += scan.stats.tiers[tier];
+        lod_stats.out_of_sight += scan.stats.out_of_sight;
+    }
+    lod_stats.updated = static_cast<uint>(update_order.size());
+}
+
+void BoidSim::PopulateNeighbors(uint boid, PopulateChunk & chunk) const
+{
+    chunk.boids.emplace_back(boid);
+    
+    PE::Vec3 boid_position = Boids.GetPosition(boid);
+    
+    // Check for neighbors in grid cubes near the boid's. In k-nearest mode they were already found.
+    if (neighbor_mode != NeighborMode::KNearest)
+    {
+        chunk.search_cells.clear();
+        PositionGrid->GatherCells(boid_position, neighbor_search_distance, chunk.search_cells);
+        uint added = FilterSearchCells(boid_position, gather_dist_squared, Boids, chunk, chunk.neighbors);
+        chunk.cells_scanned += chunk.search_cells.size();
+        chunk.candidates_checked += chunk.candidates.size();
+        chunk.neighbor_counts.emplace_back(added);
+    }
+    
+    // Search each feared group through its own spatial index.
+    float fear_distance = std::sqrt(fear_dist_squared);
+    for (uint feared_group = 0; feared_group < FearedBoids.size(); ++feared_group)
+    {
+        const BoidSim * feared = FearedBoids[feared_group];
+        chunk.search_cells.clear();
+        feared->GetSpatialIndex().GatherRadius(boid_position, fear_distance, chunk.search_cells);
+        uint feared_added = FilterSearchCells(boid_position, fear_dist_squared, feared->GetBoids(), chunk,
+                                              chunk.fear_neighbors[feared_group]);
+        chunk.fear_counts[feared_group].emplace_back(feared_added);
+    }
+}
+
+uint BoidSim::FilterSearchCells(const PE::Vec3 & position, float radius_squared, const BoidStorage & boids,
+                                       PopulateChunk & chunk, std::vector<uint> & out)
+{
+    // Cells only hold a few boids each, so gather them into one run to keep
+    // the vector kernel busy, then filter straight into the output and trim.
+    uint num_candidates = 0;
+    for (const IndexSpan & cell : chunk.search_cells)
+        num_candidates += cell.size();
+    chunk.candidates.resize(num_candidates);
+    uint * candidate = chunk.candidates.data();
+    for (const IndexSpan & cell : chunk.search_cells)
+        candidate = std::copy(cell.begin(), cell.end(), candidate);
+    
+    size_t first = out.size();
+    out.resize(first + num_candidates + KERNEL_PADDING);
+    uint added = GetBoidKernels().FilterNeighbors(&position.x, radius_squared, boids.Arrays(), chunk.candidates.data(),
+                                                  num_candidates, out.data() + first);
+    out.resize(first + added);
+    return added;
+}
+
+void BoidSim::CommitNeighbors(const PopulateChunk & chunk)
+{
+    const uint * neighbors = chunk.neighbors.data();
+    for (uint i = 0; i < chunk.boids.size(); ++i)
+    {
+        Neighbors.Assign(chunk.boids[i], neighbors, chunk.neighbor_counts[i]);
+        Neighbors.SetStamp(chunk.boids[i], Handles.GetEpoch());
+        Boids.SetListAnchor(chunk.boids[i], travel, tick);
+        neighbors += chunk.neighbor_counts[i];
+    }
+    counters.populated += chunk.boids.size();
+    counters.cells_scanned += chunk.cells_scanned;
+    counters.candidates_checked += chunk.candidates_checked;
+    counters.neighbors_found += chunk.neighbors.size();
+    
+    for (uint feared_group = 0; feared_group < FearedBoids.size(); ++feared_group)
+    {
+        const uint * feared = chunk.fear_neighbors[feared_group].data();
+        uint feared_epoch = FearedBoids[feared_group]->Handles.GetEpoch();
+        for (uint i = 0; i < chunk.boids.size(); ++i)
+        {
+            FearNeighbors[feared_group].Assign(chunk.boids[i], feared, chunk.fear_counts[feared_group][i]);
+            FearNeighbors[feared_group].SetStamp(chunk.boids[i], feared_epoch);
+            feared += chunk.fear_counts[feared_group][i];
+        }
+    }
+}
+
+void BoidSim::UpdateForce(uint boid, std::vector<uint> & scratch, std::vector<uint> & in_range)
+{
+    PE::Vec3 position = Boids.GetPosition(boid);
+    PE::Vec3 force = Boids.GetForce(boid);
+    PE::Vec3 avoid_force{}, align_force{}, cohesion_force{}, fear_force{};
+    NeighborList::Row neighbors = Neighbors.Get(boid);
+    
+    // Boids were removed since the list was gathered, so skip entries whose index changed hands.
+    uint stamp = Neighbors.GetStamp(boid);
+    if (stamp != Handles.GetEpoch())
+    {
+        scratch.clear();
+        for (uint neighbor : neighbors)
+            if (Handles.SameBoid(neighbor, stamp))
+                scratch.emplace_back(neighbor);
+        neighbors = NeighborList::Row{scratch.data(), scratch.data() + scratch.size()};
+    }
+    
+    // Verlet lists reach out past the neighbor distance, only those within it take part.
+    if (neighbor_mode == NeighborMode::Verlet)
+    {
+        in_range.resize(neighbors.size() + KERNEL_PADDING);
+        uint count = GetBoidKernels().FilterNeighbors(&position.x, neighbor_dist_squared,
+                                                      Boids.Arrays(), neighbors.first, neighbors.size(),
+                                                      in_range.data());
+        neighbors = NeighborList::Row{in_range.data(), in_range.data() + count};
+    }
+    
+    if (!neighbors.empty())
+    {
+        // Get forces from behaviors.
+        BehaviorSums sums = GetBoidKernels().AccumulateBehaviors(&position.x, Boids.Arrays(), neighbors.first,
+                                                                 neighbors.size());
+        force += avoid_force = PE::Vec3{sums.avoid[0], sums.avoid[1], sums.avoid[2]} * AvoidFactor;
+        if (LongRangeDistance <= 0)
+        {
+            PE::Vec3 align{sums.align[0], sums.align[1], sums.align[2]};
+            PE::Vec3 cohesion{sums.cohesion[0], sums.cohesion[1], sums.cohesion[2]};
+            force += align_force = glm::normalize(align) * AlignFactor;
+            force += cohesion_force = glm::normalize(cohesion) * CohesionFactor;
+        }
+    }
+    if (LongRangeDistance > 0)
+    {
+        // The sums count this boid too. Its offset is zero, but its velocity has to come back out.
+        const FlockSums & flock = FlockTree.GetSums(boid);
+        PE::Vec3 align = flock.velocity - Boids.GetVelocity(boid);
+        if (align != PE::Vec3{0})
+            force += align_force = glm::normalize(align) * AlignFactor;
+        if (flock.offset != PE::Vec3{0})
+            force += cohesion_force = glm::normalize(flock.offset) * CohesionFactor;
+    }
+    force += fear_force = FearVector(boid) * FearFactor;
+    PE::Vec3 area_force = AreaVector(boid) * AreaFactor;
+    force += area_force;
+    
+    // Can't normalize a 0 vector
+    if (force != PE::Vec3{0})
+        force = glm::normalize(force);
+    Boids.SetForce(boid, force);
+}
+
+void BoidSim::MoveBoid(uint boid, float dt)
+{
+    PE::Vec3 position = Boids.GetPosition(boid);
+    
+    if (ContinuousContainer && glm::length(position) > area_size * 1.5f)
+        position *= -1;
+    if (HardContainer && glm::length(position) > area_size * 1.5f)
+        position = glm::normalize(position) * area_size * 1.5f;
+    
+    // Remember where the tick starts for drawing in between ticks. Taken after the
+    // container moves the boid, so wrapping around isn't drawn as a streak across the area.
+    Boids.SetPosition(boid, position);
+    Boids.SaveLastState(boid);
+    
+    // Add the force to shift the direction of the velocity toward where the boid
+    // wants to go, then scale that velocity to move speed.
+    PE::Vec3 velocity = Boids.GetVelocity(boid);
+    velocity += Boids.GetForce(boid) * TurnForce * dt;
+    velocity = glm::normalize(velocity) * Boids.GetSpeed(boid) * Speed;
+    
+    // Update position.
+    position += velocity * dt;
+    
+    Boids.SetPosition(boid, position);
+    Boids.SetVelocity(boid, velocity);
+}
+
+void BoidSim::UpdateGridPosition(uint boid_index)
+{
+    CellKey new_cell = PositionGrid->GetKey(Boids.GetPosition(boid_index));
+    if (new_cell != Boids.GetGridCell(boid_index))
+    {
+        PositionGrid->Move(boid_index, Boids.GetGridCell(boid_index), new_cell);
+        Boids.SetGridCell(boid_index, new_cell);
+    }
+}
+
+void BoidSim::BuildInstances(float alpha, BoidInstance * out) const
+{
+    PE::ThreadPool::GetInstance().ParallelFor(Boids.Size(), INSTANCE_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        // Blend between the last two ticks.
+        for (uint boid = begin; boid < end; ++boid)
+        {
+            out[boid].position = glm::mix(Boids.GetLastPosition(boid), Boids.GetPosition(boid), alpha);
+            out[boid].velocity = glm::mix(Boids.GetLastVelocity(boid), Boids.GetVelocity(boid), alpha);
+        }
+    });
+}
+
+void BoidSim::MakeBoid(uint boid, const float * random)
+{
+    // Random location in the area, random heading and a speed from 1 to 2, from values in [-1, 1).
+    // The corners of the spawn cube poke out of the container, so pull those boids back in now
+    // rather than letting their first move jump them there.
+    PE::Vec3 position = PE::Vector{random[0], random[1], random[2]} * area_size;
+    if (HardContainer && glm::length(position) > area_size * 1.5f)
+        position = glm::normalize(position) * area_size * 1.5f;
+    Boids.SetPosition(boid, position);
+    Boids.SetVelocity(boid, glm::normalize(PE::Vector{random[3], random[4], random[5]}));
+    Boids.SetSpeed(boid, 1.5f + 0.5f * random[6]);
+    Boids.SaveLastState(boid);
+    Boids.SetGridCell(boid, PositionGrid->GetKey(Boids.GetPosition(boid)));
+}
+
+void BoidSim::AddFearedBoids(const BoidSim * feared_boids)
+{
+    // Avoid adding the same boids twice.
+    for (auto * b : FearedBoids)
+        if (b == feared_boids)
+            return;
+    
+    FearedBoids.emplace_back(feared_boids);
+    // Since we added a new group of feared boids, we need a list for it with a row for each boid.
+    FearNeighbors.emplace_back();
+    FearNeighbors.back().Resize(Boids.Size());
+    FearedGenerations.emplace_back(feared_boids->reorder_generation);
+}
+
+void BoidSim::RemoveFearedBoids(const BoidSim * removed_fear)
+{
+    int remove_index = -1;
+    for (uint i = 0; i < FearedBoids.size(); ++i)
+        if (FearedBoids[i] == removed_fear)
+        {
+            remove_index = i;
+            break;
+        }
+    
+    // Cant remove something not on the list.
+    if (remove_index == -1)
+        return;
+    
+    // Remove feared boids from controller and each boids' neighbor list.
+    FearedBoids.erase(FearedBoids.begin() + remove_index);
+    FearNeighbors.erase(FearNeighbors.begin() + remove_index);
+    FearedGenerations.erase(FearedGenerations.begin() + remove_index);
+}
+
+void BoidSim::SetFearDistance(float distance)
+{
+    fear_dist_squared = distance * distance;
+}
+
+void BoidSim::SetNeighborDistance(float distance)
+{
+    neighbor_dist_squared = distance * distance;
+    verlet_lists_stale = true;
+    UpdateNeighborSearchDistance();
+}
+
+void BoidSim::SetAreaSize(float size)
+{
+    // The control panel sets this every frame, so skip the grid rebuild unless it changed.
+    if (size == area_size)
+        return;
+    
+    area_size = size;
+    UpdateNeighborSearchDistance();
+}
+
+void BoidSim::SetGridMode(GridMode mode)
+{
+    if (mode == grid_mode)
+        return;
+    
+    // Release the backend we're leaving.
+    PositionGrid->Clear();
+    
+    grid_mode = mode;
+    if (mode == GridMode::Bounded)
+        PositionGrid = &BoundedGrid;
+    else
+        PositionGrid = &UnboundedGrid;
+    
+    UpdateNeighborSearchDistance();
+}
+
+GridMode BoidSim::GetGridMode() const
+{
+    return grid_mode;
+}
+
+void BoidSim::SetNeighborMode(NeighborMode mode)
+{
+    if (mode == neighbor_mode)
+        return;
+    
+    // Lists gathered at another radius can't be trusted to cover the new one.
+    neighbor_mode = mode;
+    verlet_lists_stale = true;
+    UpdateNeighborSearchDistance();
+}
+
+NeighborMode BoidSim::GetNeighborMode() const
+{
+    return neighbor_mode;
+}
+
+void BoidSim::SetVerletSkin(float skin)
+{
+    skin = std::max(skin, MIN_VERLET_SKIN);
+    if (skin == verlet_skin)
+        return;
+    
+    verlet_skin = skin;
+    verlet_lists_stale = true;
+    if (neighbor_mode == NeighborMode::Verlet)
+        UpdateNeighborSearchDistance();
+}
+
+float BoidSim::GetVerletSkin() const
+{
+    return verlet_skin;
+}
+
+void BoidSim::SetNeighborCount(uint count)
+{
+    neighbor_count = count < KdTree::MAX_NEAREST ? count : KdTree::MAX_NEAREST;
+}
+
+uint BoidSim::GetNeighborCount() const
+{
+    return neighbor_count;
+}
+
+void BoidSim::SetView(const SimView & view)
+{
+    lod_view = view;
+    has_view = true;
+    
+    // Each side of the clip volume is the bottom row of the transform plus or minus one of
+    // the other rows, normalized here so a plane's offset from a point is a real distance.
+    // Without a frustum, every plane passes every point.
+    if (!view.has_frustum)
+    {
+        std::fill(frustum_planes, frustum_planes + 6, PE::Vec4{0, 0, 0, 1});
+        return;
+    }
+    
+    const PE::Mat4 & transform = view.view_projection;
+    for (uint axis = 0; axis < 3; ++axis)
+        for (uint side = 0; side < 2; ++side)
+        {
+            PE::Vec4 & plane = frustum_planes[axis * 2 + side];
+            for (uint column = 0; column < 4; ++column)
+                plane[column] = transform[column][3] + (side ? -transform[column][axis] : transform[column][axis]);
+            plane /= glm::length(PE::Vec3(plane));
+        }
+}
+
+void BoidSim::UpdateNeighborSearchDistance()
+{
+    // Verlet lists are gathered, and cells sized, out to the skin.
+    float distance = std::sqrt(neighbor_dist_squared);
+    if (neighbor_mode == NeighborMode::Verlet)
+        distance += verlet_skin;
+    gather_dist_squared = distance * distance;
+    
+    // Make cells about as wide as the neighbor distance, so a search only covers adjacent cells.
+    // The bounded grid covers a little more than the area boids are contained to.
+    BoundedGrid.SetBounds(area_size * 1.2f, area_size * 2.4f, distance);
+    UnboundedGrid.SetCellSize(distance);
+    neighbor_search_distance = static_cast<int>(std::ceil(distance / PositionGrid->GetCellSize()));
+    
+    // Every boid's cell key depends on the grid layout.
+    PopulateGrid();
+}
+
+
+//----------------------------------------------------------------------------------------------------------------------
+// Memory ordering code.
+
+void BoidSim::UpdateMortonOrder()
+{
+    // Apply a finished sort. Any permutation is valid, so it doesn't matter that boids
+    // have moved since it started, as long as none were added or removed.
+    if (morton_sort.valid() && morton_sort.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        std::vector<uint> order = morton_sort.get();
+        if (order.size() == Boids.Size())
+            ReorderBoids(order);
+    }
+    
+    if (MortonSortInterval == 0 || morton_sort.valid() || ++morton_sort_counter < MortonSortInterval)
+        return;
+    morton_sort_counter = 0;
+    
+    // Snapshot the code of each boid's cell. The boids themselves keep moving during the sort.
+    float inverse_cell_size = 1.f / PositionGrid->GetCellSize();
+    std::vector<std::pair<std::uint64_t, uint>> codes(Boids.Size());
+    for (uint i = 0; i < Boids.Size(); ++i)
+        codes[i] = {MortonCode(Boids.GetPosition(i), inverse_cell_size), i};
+    
+    // Sort within each batch, so no boid leaves the range it belongs to.
+    std::vector<uint> batch_starts = GetOrderBatchStarts();
+    
+    morton_sort = std::async(std::launch::async, [codes = std::move(codes), batch_starts]() mutable
+    {
+        for (uint batch = 0; batch < batch_starts.size(); ++batch)
+        {
+            auto first = codes.begin() + batch_starts[batch];
+            auto last = batch + 1 < batch_starts.size() ? codes.begin() + batch_starts[batch + 1] : codes.end();
+            std::sort(first, last);
+        }
+        
+        std::vector<uint> order(codes.size());
+        for (uint i = 0; i < codes.size(); ++i)
+            order[i] = codes[i].second;
+        return order;
+    });
+}
+
+void BoidSim::ReorderBoids(const std::vector<uint> & order)
+{
+    reorder_remap.resize(order.size());
+    for (uint i = 0; i < order.size(); ++i)
+        reorder_remap[order[i]] = i;
+    
+    Boids.Permute(order);
+    Handles.Permute(order);
+    Neighbors.Permute(order, &reorder_remap);
+    for (auto & fear_neighbors : FearNeighbors)
+        fear_neighbors.Permute(order, nullptr);
+    
+    PositionGrid->Build(Boids.GridCells(), Boids.Size());
+    NearestTree.Clear();
+    
+    // Boids still waiting for their first neighbors are scattered now, the regular round reaches them.
+    unpopulated_first = Boids.Size();
+    
+    // Let the controllers that fear these boids know their indices moved.
+    ++reorder_generation;
+}
+
+void BoidSim::SyncFearedOrder()
+{
+    for (uint feared_group = 0; feared_group < FearedBoids.size(); ++feared_group)
+    {
+        const BoidSim * feared = FearedBoids[feared_group];
+        uint & generation = FearedGenerations[feared_group];
+        if (generation == feared->reorder_generation)
+            continue;
+        
+        // A single reorder can be followed exactly. If we somehow missed more than one,
+        // drop the lists and let them repopulate.
+        if (feared->reorder_generation == generation + 1)
+            FearNeighbors[feared_group].RemapValues(feared->reorder_remap);
+        else
+        {
+            FearNeighbors[feared_group].Clear();
+            FearNeighbors[feared_group].Resize(Boids.Size());
+        }
+        generation = feared->reorder_generation;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+// Behavior code.
+
+PE::Vector BoidSim::FearVector(uint boid) const
+{
+    PE::Vector bVector{};
+    PE::Vec3 position = Boids.GetPosition(boid);
+    
+    // For each group of feared boids, calculate for each neighboring boid from that group.
+    for (uint feared_group = 0; feared_group < FearNeighbors.size(); ++feared_group)
+    {
+        const BoidStorage & feared = FearedBoids[feared_group]->Boids;
+        const SlotMap & feared_handles = FearedBoids[feared_group]->Handles;
+        uint stamp = FearNeighbors[feared_group].GetStamp(boid);
+        for (auto feared_boid : FearNeighbors[feared_group].Get(boid))
+        {
+            // The feared group may have lost boids since this list was built.
+            if (stamp != feared_handles.GetEpoch() && !feared_handles.SameBoid(feared_boid, stamp))
+                continue;
+            
+            PE::Vec3 other = feared.GetPosition(feared_boid);
+            float dist2 = glm::distance2(other, position);
+            if (dist2 != 0.f)
+                bVector += (position - other) / dist2;
+        }
+    }
+    
+    // We don't know if there were any feared boids in range, so we have to check for a 0 vector.
+    //if (bVector != PE::Vec3{0})
+    //    bVector = glm::normalize(bVector);
+    
+    return bVector;
+}
+
+PE::Vector BoidSim::AreaVector(uint boid) const
+{
+    PE::Vec3 position = Boids.GetPosition(boid);
+    
+    // Gently nudge boids in if they get too far
+    return -position * std::max((glm::length(position) - area_size), 0.0f);
+}
+
+uint BoidSim::GetNumBoids() const
+{
+    return Boids.Size();
+}
+
+BoidHandle BoidSim::GetHandle(uint boid) const
+{
+    return Handles.GetHandle(boid);
+}
+
+uint BoidSim::FindBoid(BoidHandle handle) const
+{
+    return Handles.Find(handle);
+}
+
+const BoidStorage & BoidSim::GetBoids() const
+{
+    return Boids;
+}
+
+const SpatialIndex & BoidSim::GetSpatialIndex() const
+{
+    return *PositionGrid;
+}
+
+float BoidSim::GetAreaSize() const
+{
+    return area_size;
+}
+
+std::vector<uint> BoidSim::GetOrderBatchStarts() const
+{
+    return {0};
+}
+
+const SimPhaseTimes & BoidSim::GetPhaseTimes() const
+{
+    return phase_times;
+}
+
+const SimCounters & BoidSim::GetCounters() const
+{
+    return counters;
+}
+
+const SimStaleness & BoidSim::GetStaleness() const
+{
+    return staleness;
+}
+
+const SimLodStats & BoidSim::GetLodStats() const
+{
+    return lod_stats;
+}
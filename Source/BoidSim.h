@@ -0,0 +1,374 @@
+#pragma once
+
+#include <vector>
+#include <future>
+#include <cstdint>
+#include "Engine/Types.h"
+#include "BoidStorage.h"
+#include "NeighborList.h"
+#include "SlotMap.h"
+#include "BudgetScheduler.h"
+#include "CellList.h"
+#include "HashGrid.h"
+#include "KdTree.h"
+#include "Octree.h"
+
+// Spatial index used for neighbor lookup.
+enum class GridMode
+{
+    // Dense cell list covering the container area.
+    Bounded,
+    // Sparse hash grid covering all of space.
+    Unbounded
+};
+
+// How neighbor lists are kept up to date.
+enum class NeighborMode
+{
+    // A share of the boids regathers each tick in turn, however far they have moved.
+    Staggered,
+    // Lists reach a skin past the neighbor distance and are regathered once boids
+    // may have moved far enough for one outside the list to come within range.
+    Verlet,
+    // Lists hold a fixed number of nearest boids however far away they are, regathered
+    // in turn like Staggered, so crowded boids cost no more than sparse ones.
+    KNearest
+};
+
+// How out of date the neighbor lists were at the start of the latest tick. Only kept in Verlet mode.
+struct SimStaleness
+{
+    // Ticks since the oldest list was gathered, and the average over all lists.
+    uint max_age = 0;
+    double mean_age = 0;
+    
+    // Largest share of the skin any list had used up. Lists past 1 are regathered.
+    float max_drift = 0;
+};
+
+// Neighbor search work done by the populate pass of the latest tick.
+struct SimCounters
+{
+    std::uint64_t populated = 0;
+    std::uint64_t cells_scanned = 0;
+    std::uint64_t candidates_checked = 0;
+    std::uint64_t neighbors_found = 0;
+};
+
+// Most level of detail tiers, each refreshing boids half as often as the one before.
+const uint MAX_LOD_TIERS = 8;
+
+// Where a group is seen from, in the group's own space, for level of detail.
+struct SimView
+{
+    PE::Vec3 position{};
+    
+    // Boids outside this transform's clip volume are out of sight. Without one, every boid is in sight.
+    PE::Mat4 view_projection{1};
+    bool has_frustum = false;
+};
+
+// What the renderer needs to draw one boid. The vertex shader builds the boid's transform
+// from these, facing along the velocity with up pointing away from the center.
+struct BoidInstance
+{
+    PE::Vec3 position;
+    PE::Vec3 velocity;
+};
+
+// How level of detail split up the boids at the start of the latest tick.
+struct SimLodStats
+{
+    uint tiers[MAX_LOD_TIERS] = {};
+    
+    // Boids outside the view's frustum, all put in the last tier.
+    uint out_of_sight = 0;
+    
+    // Boids that recalculated their heading.
+    uint updated = 0;
+};
+
+/*!
+@brief The flocking simulation for one group of boids, with no rendering.
+   Depends only on glm and the standard library, so it also runs on
+   machines without a display.
+*/
+class BoidSim
+{
+    // Boids whose Verlet lists are due, found by one chunk of the scan over all boids.
+    struct VerletScanChunk
+    {
+        std::vector<uint> due;
+        uint max_age = 0;
+        std::uint64_t age_sum = 0;
+        float max_drift = 0;
+    };
+    
+    // Boids due this tick under level of detail, found by one chunk of the scan over all boids.
+    struct LodScanChunk
+    {
+        std::vector<uint> updates;
+        std::vector<uint> populates;
+        SimLodStats stats;
+    };
+    
+    // Neighbor lists gathered by one chunk of the parallel populate pass,
+    // held until they are committed in boid order.
+    struct PopulateChunk
+    {
+        std::vector<IndexSpan> search_cells;
+        std::vector<uint> candidates;
+        std::vector<uint> boids;
+        std::vector<uint> neighbors;
+        std::vector<uint> neighbor_counts;
+        
+        // Own-group search work, summed into the tick's counters on commit.
+        std::uint64_t cells_scanned = 0;
+        std::uint64_t candidates_checked = 0;
+        
+        // One list of feared boids and counts per feared group.
+        std::vector<std::vector<uint>> fear_neighbors;
+        std::vector<std::vector<uint>> fear_counts;
+    };
+    
+public:
+    BoidSim();
+    virtual ~BoidSim() = default;
+    
+    // Adds num boids after the existing ones.
+    void AddBoids(uint num);
+    
+    // Removes the last num boids.
+    void RemoveBoids(uint num);
+    
+    /*!
+    @brief Removes the boids the handles name, skipping any already gone.
+       Each one is replaced by the last boid, so the cost of a removal doesn't
+       grow with the number of boids, and lists that named either index are
+       fixed up as they are read.
+    */
+    void RemoveBoids(const std::vector<BoidHandle> & handles);
+    
+    // Handle that keeps naming the boid at this index after others are removed or reordered.
+    [[nodiscard]] BoidHandle GetHandle(uint boid) const;
+    
+    // Current index of the handle's boid, or NO_BOID if it has been removed.
+    [[nodiscard]] uint FindBoid(BoidHandle handle) const;
+    
+    // Advances the simulation by one fixed tick of dt seconds.
+    void Update(float dt);
+    
+    // Behavior attributes.
+    float AvoidFactor = 1;
+    float AlignFactor = 1;
+    float CohesionFactor = 1;
+    float AreaFactor = 1;
+    float FearFactor = 1;
+    
+    float Speed = 1;
+    float TurnForce = 1;
+    
+    bool HardContainer = true;
+    bool ContinuousContainer = false;
+    
+    // Cohesion and alignment reach every boid within this distance through an octree
+    // built each tick, leaving the neighbor lists to avoidance alone. 0 turns it off.
+    float LongRangeDistance = 0;
+    
+    // How large an octree node may look from a boid, as size over distance, and still
+    // count as its center of mass where the long range distance cuts through it. 0 is exact.
+    float OpeningAngle = 0.5f;
+    
+    // How many boids should recalculate their heading each frame.
+    uint updates_per_frame = 1000;
+    
+    // How many boids should recalculate their grid position each frame.
+    uint grid_updates_per_frame = 1000;
+    
+    // How mant boids should repopulate their neighbor list each frame.
+    uint populates_per_frame = 1000;
+    
+    // When given a target time, sets the three budgets above every tick from
+    // how long the phases took. Timing dependent, so runs stop being repeatable.
+    BudgetScheduler Scheduler;
+    
+    // Random stream new boids are drawn from under the global seed. Each sim
+    // gets its own by default, so groups spawned with the same seed don't overlap.
+    std::uint64_t SpawnStream;
+    
+    // Every this many frames, re-sort boids along a Z-order curve in the
+    // background so spatial neighbors sit close together in memory. 0 disables it.
+    uint MortonSortInterval = 0;
+    
+    // Level of detail. Boids this far from the view drop a tier, and another at every doubling
+    // of the distance, and boids out of sight drop to the last tier. Each tier recalculates
+    // headings and repopulates neighbor lists half as often as the one before it, so no boid
+    // waits more than 2^(LodTiers - 1) times as long as at full detail, or twice that just
+    // after boids are reordered. 0 turns it off, as does never being given a view.
+    float LodDistance = 0;
+    uint LodTiers = 4;
+    
+    // Sets where the group is seen from. Viewers call this every tick as the camera moves.
+    void SetView(const SimView & view);
+    
+    void AddFearedBoids(const BoidSim * feared_boids);
+    void RemoveFearedBoids(const BoidSim * removed_fear);
+    void SetFearDistance(float distance);
+    void SetNeighborDistance(float distance);
+    void SetAreaSize(float size);
+    float GetAreaSize() const;
+    void SetGridMode(GridMode mode);
+    GridMode GetGridMode() const;
+    void SetNeighborMode(NeighborMode mode);
+    NeighborMode GetNeighborMode() const;
+    
+    // Extra distance Verlet lists reach past the neighbor distance. A wider skin
+    // means longer lists, but each one lasts longer before it has to be regathered.
+    void SetVerletSkin(float skin);
+    float GetVerletSkin() const;
+    
+    // Neighbors each boid keeps in k-nearest mode, at most KdTree::MAX_NEAREST.
+    void SetNeighborCount(uint count);
+    uint GetNeighborCount() const;
+    uint GetNumBoids() const;
+    
+    // For controllers that fear these boids to search them by position.
+    const BoidStorage & GetBoids() const;
+    const SpatialIndex & GetSpatialIndex() const;
+    
+    const SimPhaseTimes & GetPhaseTimes() const;
+    const SimCounters & GetCounters() const;
+    const SimStaleness & GetStaleness() const;
+    const SimLodStats & GetLodStats() const;
+    
+    // Recomputes every boid's cell and rebuilds the spatial index from scratch.
+    void PopulateGrid();
+    
+    // Writes each boid's position and velocity alpha of the way from the previous tick to the
+    // latest one to out, which has room for every boid.
+    void BuildInstances(float alpha, BoidInstance * out) const;
+    
+protected:
+    // Start index of each range of boids that reordering must keep boids
+    // inside. By default all boids form a single range.
+    [[nodiscard]] virtual std::vector<uint> GetOrderBatchStarts() const;
+    
+private:
+    void MakeBoid(uint boid, const float * random);
+    void RescaleBudgets(uint old_size, uint new_size);
+    void SwapRemove(uint boid);
+    void FinishRemoval(uint old_size, uint old_epoch);
+    void ExpireListsNear(const std::vector<uint> & arrivals);
+    void PopulateNeighbors(uint boid, PopulateChunk & chunk) const;
+    static uint FilterSearchCells(const PE::Vec3 & position, float radius_squared, const BoidStorage & boids,
+                                  PopulateChunk & chunk, std::vector<uint> & out);
+    void CommitNeighbors(const PopulateChunk & chunk);
+    void SelectPopulates(uint num_boids);
+    void FindDueVerletLists(uint num_boids);
+    void FindDueLodBoids(uint num_boids);
+    void UpdateForce(uint boid, std::vector<uint> & scratch, std::vector<uint> & in_range);
+    void MoveBoid(uint boid, float dt);
+    void UpdateGridPosition(uint boid_index);
+    
+    [[nodiscard]] PE::Vector FearVector(uint boid) const;
+    [[nodiscard]] PE::Vector AreaVector(uint boid) const;
+    
+    void UpdateNeighborSearchDistance();
+    void UpdateMortonOrder();
+    void ReorderBoids(const std::vector<uint> & order);
+    void SyncFearedOrder();
+    
+    // The size of area boids try to stay within.
+    float area_size = 10;
+    float neighbor_dist_squared = 1;
+    int neighbor_search_distance = 1;
+    
+    // Radius lists are gathered out to, the neighbor distance plus the skin in Verlet mode.
+    float gather_dist_squared = 1;
+    NeighborMode neighbor_mode = NeighborMode::Staggered;
+    float verlet_skin = 1;
+    
+    // Sum over the ticks of the furthest any boid moved in each, so no boid can have moved
+    // further since a list was gathered than the difference. Only advanced in Verlet mode.
+    double travel = 0;
+    
+    // Every Verlet list is due, as they were gathered by another mode or radius.
+    bool verlet_lists_stale = true;
+    uint tick = 0;
+    
+    // Rebuilt every tick in k-nearest mode.
+    KdTree NearestTree;
+    uint neighbor_count = 7;
+    
+    // Rebuilt every tick while LongRangeDistance is set.
+    Octree FlockTree;
+    
+    // Level of detail view, with the planes of its frustum as inward facing normals and offsets.
+    SimView lod_view;
+    bool has_view = false;
+    PE::Vec4 frustum_planes[6];
+    float fear_dist_squared = 25;
+    
+    std::vector<const BoidSim *> FearedBoids;
+    BoidStorage Boids;
+    
+    // Stable handles of the boids, and the epochs that tell stale neighbor entries apart.
+    SlotMap Handles;
+    
+    // Store neighbors by index to avoid
+    // pointer invalidation when adding boids.
+    NeighborList Neighbors;
+    
+    // One list per feared group, indexing into that group's boids.
+    std::vector<NeighborList> FearNeighbors;
+    
+    // Reorder generation of each feared group when its list was last valid.
+    std::vector<uint> FearedGenerations;
+    
+    // Boid indices filed by the grid cell they occupy. PositionGrid
+    // points at whichever backend the grid mode selects.
+    CellList BoundedGrid;
+    HashGrid UnboundedGrid;
+    SpatialIndex * PositionGrid = &BoundedGrid;
+    GridMode grid_mode = GridMode::Bounded;
+    
+    // Indices a removal moved a boid into, for expiring the Verlet lists that miss it.
+    std::vector<uint> removal_holes;
+    
+    // Staging for the parallel populate pass, kept to reuse its memory.
+    std::vector<PopulateChunk> PopulateChunks;
+    std::vector<VerletScanChunk> VerletScanChunks;
+    std::vector<LodScanChunk> LodScanChunks;
+    std::vector<float> MoveSteps;
+    
+    // Boids to repopulate this tick, in the order their lists are committed.
+    std::vector<uint> populate_order;
+    
+    // Boids to recalculate the heading of this tick.
+    std::vector<uint> update_order;
+    
+    // Boids ever spawned, so each new boid draws from a fresh part of the spawn stream.
+    std::uint64_t spawned_boids = 0;
+    
+    // Boids from here to the end were added since the populate pass last
+    // reached them, so they have no neighbors yet.
+    uint unpopulated_first = 0;
+    
+    uint populates_counter = 0;
+    uint updates_counter = 0;
+    uint grid_updates_counter = 0;
+    
+    // Pending background sort, producing the new order of boid indices.
+    std::future<std::vector<uint>> morton_sort;
+    uint morton_sort_counter = 0;
+    
+    // Bumped whenever boids are reordered. reorder_remap maps each index
+    // from before the latest reorder to its index after it.
+    uint reorder_generation = 0;
+    std::vector<uint> reorder_remap;
+    
+    SimPhaseTimes phase_times;
+    SimCounters counters;
+    SimStaleness staleness;
+    SimLodStats lod_stats;
+};
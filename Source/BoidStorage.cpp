@@ -0,0 +1,123 @@
+#include "BoidStorage.h"
+
+void BoidStorage::Reserve(uint num)
+{
+    pos_x.reserve(num);
+    pos_y.reserve(num);
+    pos_z.reserve(num);
+    vel_x.reserve(num);
+    vel_y.reserve(num);
+    vel_z.reserve(num);
+    packed.reserve(num);
+    last_pos_x.reserve(num);
+    last_pos_y.reserve(num);
+    last_pos_z.reserve(num);
+    last_vel_x.reserve(num);
+    last_vel_y.reserve(num);
+    last_vel_z.reserve(num);
+    force_x.reserve(num);
+    force_y.reserve(num);
+    force_z.reserve(num);
+    speed.reserve(num);
+    grid_cell.reserve(num);
+    list_pos_x.reserve(num);
+    list_pos_y.reserve(num);
+    list_pos_z.reserve(num);
+    list_travel.reserve(num);
+    list_tick.reserve(num);
+}
+
+void BoidStorage::Resize(uint num)
+{
+    pos_x.resize(num);
+    pos_y.resize(num);
+    pos_z.resize(num);
+    vel_x.resize(num);
+    vel_y.resize(num);
+    vel_z.resize(num);
+    packed.resize(num);
+    last_pos_x.resize(num);
+    last_pos_y.resize(num);
+    last_pos_z.resize(num);
+    last_vel_x.resize(num);
+    last_vel_y.resize(num);
+    last_vel_z.resize(num);
+    force_x.resize(num);
+    force_y.resize(num);
+    force_z.resize(num);
+    speed.resize(num, 1);
+    grid_cell.resize(num, 0);
+    list_pos_x.resize(num);
+    list_pos_y.resize(num);
+    list_pos_z.resize(num);
+    list_travel.resize(num, NEVER_GATHERED);
+    list_tick.resize(num);
+}
+
+void BoidStorage::Clear()
+{
+    Resize(0);
+}
+
+void BoidStorage::Move(uint from, uint to)
+{
+    pos_x[to] = pos_x[from];
+    pos_y[to] = pos_y[from];
+    pos_z[to] = pos_z[from];
+    vel_x[to] = vel_x[from];
+    vel_y[to] = vel_y[from];
+    vel_z[to] = vel_z[from];
+    packed[to] = packed[from];
+    last_pos_x[to] = last_pos_x[from];
+    last_pos_y[to] = last_pos_y[from];
+    last_pos_z[to] = last_pos_z[from];
+    last_vel_x[to] = last_vel_x[from];
+    last_vel_y[to] = last_vel_y[from];
+    last_vel_z[to] = last_vel_z[from];
+    force_x[to] = force_x[from];
+    force_y[to] = force_y[from];
+    force_z[to] = force_z[from];
+    speed[to] = speed[from];
+    grid_cell[to] = grid_cell[from];
+    list_pos_x[to] = list_pos_x[from];
+    list_pos_y[to] = list_pos_y[from];
+    list_pos_z[to] = list_pos_z[from];
+    list_travel[to] = list_travel[from];
+    list_tick[to] = list_tick[from];
+}
+
+template<typename T>
+static void Gather(BoidStorage::Array<T> & values, const std::vector<uint> & order)
+{
+    BoidStorage::Array<T> permuted(values.size());
+    for (uint i = 0; i < order.size(); ++i)
+        permuted[i] = values[order[i]];
+    values.swap(permuted);
+}
+
+void BoidStorage::Permute(const std::vector<uint> & order)
+{
+    Gather(pos_x, order);
+    Gather(pos_y, order);
+    Gather(pos_z, order);
+    Gather(vel_x, order);
+    Gather(vel_y, order);
+    Gather(vel_z, order);
+    Gather(packed, order);
+    Gather(last_pos_x, order);
+    Gather(last_pos_y, order);
+    Gather(last_pos_z, order);
+    Gather(last_vel_x, order);
+    Gather(last_vel_y, order);
+    Gather(last_vel_z, order);
+    Gather(force_x, order);
+    Gather(force_y, order);
+    Gather(force_z, order);
+    Gather(speed, order);
+    Gather(grid_cell, order);
+    Gather(list_pos_x, order);
+    Gather(list_pos_y, order);
+    Gather(list_pos_z, order);
+    Gather(list_travel, order);
+    Gather(list_tick, order);
+}
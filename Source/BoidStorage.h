@@ -0,0 +1,175 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include "Engine/Types.h"
+#include "Engine/AlignedAllocator.h"
+#include "SpatialIndex.h"
+#include "BoidKernels.h"
+
+// List travel of a boid whose neighbors have never been gathered.
+const double NEVER_GATHERED = std::numeric_limits<double>::lowest();
+
+/*!
+@brief Structure-of-arrays storage for the per-boid simulation state.
+   Each component lives in its own contiguous, cache-line aligned array so
+   hot loops only pull the fields they actually read into cache.
+*/
+class BoidStorage
+{
+public:
+    template<typename T>
+    using Array = std::vector<T, PE::AlignedAllocator<T>>;
+
+    [[nodiscard]] uint Size() const
+    { return static_cast<uint>(speed.size()); }
+
+    [[nodiscard]] bool Empty() const
+    { return speed.empty(); }
+
+    void Reserve(uint num);
+    void Resize(uint num);
+    void Clear();
+
+    // Overwrites boid to with a copy of boid from.
+    void Move(uint from, uint to);
+
+    // Reorders every boid so the one at order[i] moves to index i.
+    void Permute(const std::vector<uint> & order);
+
+    [[nodiscard]] PE::Vec3 GetPosition(uint i) const
+    { return PE::Vec3{pos_x[i], pos_y[i], pos_z[i]}; }
+
+    void SetPosition(uint i, const PE::Vec3 & p)
+    {
+        pos_x[i] = p.x;
+        pos_y[i] = p.y;
+        pos_z[i] = p.z;
+        packed[i].position[0] = p.x;
+        packed[i].position[1] = p.y;
+        packed[i].position[2] = p.z;
+    }
+
+    [[nodiscard]] PE::Vec3 GetVelocity(uint i) const
+    { return PE::Vec3{vel_x[i], vel_y[i], vel_z[i]}; }
+
+    void SetVelocity(uint i, const PE::Vec3 & v)
+    {
+        vel_x[i] = v.x;
+        vel_y[i] = v.y;
+        vel_z[i] = v.z;
+        packed[i].velocity[0] = v.x;
+        packed[i].velocity[1] = v.y;
+        packed[i].velocity[2] = v.z;
+    }
+
+    [[nodiscard]] PE::Vec3 GetForce(uint i) const
+    { return PE::Vec3{force_x[i], force_y[i], force_z[i]}; }
+
+    void SetForce(uint i, const PE::Vec3 & f)
+    {
+        force_x[i] = f.x;
+        force_y[i] = f.y;
+        force_z[i] = f.z;
+    }
+
+    // State as of the previous tick, for interpolating between ticks when drawing.
+    [[nodiscard]] PE::Vec3 GetLastPosition(uint i) const
+    { return PE::Vec3{last_pos_x[i], last_pos_y[i], last_pos_z[i]}; }
+
+    [[nodiscard]] PE::Vec3 GetLastVelocity(uint i) const
+    { return PE::Vec3{last_vel_x[i], last_vel_y[i], last_vel_z[i]}; }
+
+    // Records the current position and velocity as the previous tick's state.
+    void SaveLastState(uint i)
+    {
+        last_pos_x[i] = pos_x[i];
+        last_pos_y[i] = pos_y[i];
+        last_pos_z[i] = pos_z[i];
+        last_vel_x[i] = vel_x[i];
+        last_vel_y[i] = vel_y[i];
+        last_vel_z[i] = vel_z[i];
+    }
+
+    [[nodiscard]] float GetSpeed(uint i) const
+    { return speed[i]; }
+
+    void SetSpeed(uint i, float s)
+    { speed[i] = s; }
+
+    // Key of the spatial grid cell the boid was last filed under.
+    [[nodiscard]] CellKey GetGridCell(uint i) const
+    { return grid_cell[i]; }
+
+    void SetGridCell(uint i, CellKey cell)
+    { grid_cell[i] = cell; }
+
+    // Where the boid was when its neighbor list was last gathered.
+    [[nodiscard]] PE::Vec3 GetListPosition(uint i) const
+    { return PE::Vec3{list_pos_x[i], list_pos_y[i], list_pos_z[i]}; }
+
+    // How far any boid could have travelled when the list was gathered, or NEVER_GATHERED.
+    [[nodiscard]] double GetListTravel(uint i) const
+    { return list_travel[i]; }
+
+    // Tick the list was gathered on.
+    [[nodiscard]] uint GetListTick(uint i) const
+    { return list_tick[i]; }
+
+    // Records that the boid's neighbor list was just gathered.
+    void SetListAnchor(uint i, double travel, uint tick)
+    {
+        list_pos_x[i] = pos_x[i];
+        list_pos_y[i] = pos_y[i];
+        list_pos_z[i] = pos_z[i];
+        list_travel[i] = travel;
+        list_tick[i] = tick;
+    }
+
+    // Makes the boid's list due for regathering, as if it had never been gathered.
+    void ExpireList(uint i)
+    { list_travel[i] = NEVER_GATHERED; }
+
+    // Raw component arrays for vectorized kernels.
+    [[nodiscard]] const float * PositionX() const
+    { return pos_x.data(); }
+
+    [[nodiscard]] const float * PositionY() const
+    { return pos_y.data(); }
+
+    [[nodiscard]] const float * PositionZ() const
+    { return pos_z.data(); }
+
+    [[nodiscard]] const float * VelocityX() const
+    { return vel_x.data(); }
+
+    [[nodiscard]] const float * VelocityY() const
+    { return vel_y.data(); }
+
+    [[nodiscard]] const float * VelocityZ() const
+    { return vel_z.data(); }
+
+    [[nodiscard]] BoidArrays Arrays() const
+    {
+        return BoidArrays{pos_x.data(), pos_y.data(), pos_z.data(), vel_x.data(), vel_y.data(), vel_z.data(),
+                          packed.data()};
+    }
+
+    [[nodiscard]] const CellKey * GridCells() const
+    { return grid_cell.data(); }
+
+private:
+    Array<float> pos_x, pos_y, pos_z;
+    Array<float> vel_x, vel_y, vel_z;
+
+    // Position and velocity again, interleaved for gathering neighbors. Kept in step by the setters.
+    Array<PackedBoid> packed;
+    Array<float> last_pos_x, last_pos_y, last_pos_z;
+    Array<float> last_vel_x, last_vel_y, last_vel_z;
+    Array<float> force_x, force_y, force_z;
+    Array<float> speed;
+    Array<CellKey> grid_cell;
+    Array<float> list_pos_x, list_pos_y, list_pos_z;
+    Array<double> list_travel;
+    Array<uint> list_tick;
+};
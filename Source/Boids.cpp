@@ -1,46 +1,56 @@
 #define GLM_ENABLE_EXPERIMENTAL
 
-#include <utility>
-#include <glm/gtx/vector_angle.hpp>
-#include <iostream>
+#include <cstddef>
+#include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "Boids.h"
-#include "Engine/Dice.h"
 #include "Engine/Graphics.h"
+#include "Engine/Trace.h"
 
-static const bool OUT_NEIGHBOR_CHECK_INFO = false;
+// How long to block on a region's fence before checking it again, in nanoseconds.
+static const GLuint64 REGION_WAIT_TIMEOUT = 1000000;
 
 BoidController::BoidController(std::string_view path) : Model(path)
 {
-    // Create data used to mass-render boids.
+    // Create data used to mass-render boids. Where buffer storage is available the instance
+    // buffer stays mapped and the simulation writes into it, it is made once there are boids.
+    persistent_mapping = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
     
     // vertex buffer object
     glGenBuffers(1, &BoidDataBuffer);
+    BindInstanceBuffer();
+}
+
+BoidController::~BoidController()
+{
+    for (GLsync fence : region_fences)
+        if (fence)
+            glDeleteSync(fence);
+    // Deleting the buffer also unmaps it.
+    glDeleteBuffers(1, &BoidDataBuffer);
+}
+
+void BoidController::BindInstanceBuffer()
+{
     glBindBuffer(GL_ARRAY_BUFFER, BoidDataBuffer);
     
-    // Add instance transform attributes to mesh VAOs.
+    // Add instance position and velocity attributes to mesh VAOs. The vertex shader builds each
+    // boid's transform from them, so only 24 bytes per boid are uploaded rather than a matrix.
     for (auto & mesh : meshes)
     {
         unsigned int VAO = mesh.VAO;
         glBindVertexArray(VAO);
         // vertex attributes
-        GLsizei vec4Size = sizeof(glm::vec4);
+        GLsizei stride = sizeof(BoidInstance);
         glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void *) 0);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride,
+                              (void *) static_cast<unsigned long long>(offsetof(BoidInstance, position)));
         glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE,
-                              4 * vec4Size, (void *) static_cast<unsigned long long>(1 * vec4Size));
-        glEnableVertexAttribArray(5);
-        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE,
-                              4 * vec4Size, (void *) static_cast<unsigned long long>(2 * vec4Size));
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE,
-                              4 * vec4Size, (void *) static_cast<unsigned long long>(3 * vec4Size));
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride,
+                              (void *) static_cast<unsigned long long>(offsetof(BoidInstance, velocity)));
         
         glVertexAttribDivisor(3, 1);
         glVertexAttribDivisor(4, 1);
-        glVertexAttribDivisor(5, 1);
-        glVertexAttribDivisor(6, 1);
         
         glBindVertexArray(0);
     }
@@ -48,354 +58,84 @@ BoidController::BoidController(std::string_view path) : Model(path)
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void BoidController::AddBoids(uint num)
-{
-    Boids.reserve(Boids.size() + num);
-    for (uint i = 0; i < num; ++i)
-        Boids.emplace_back(MakeBoid());
-    
-    BoidData.resize(Boids.size());
-    
-    updates_per_frame = static_cast<uint>(Boids.size() / 2);
-    grid_updates_per_frame = static_cast<uint>(Boids.size() / 32);
-    populates_per_frame = static_cast<uint>(Boids.size() / 120);
-    
-    // Place all boids in their appropriate grid position.
-    PopulateGrid();
-}
-
-void BoidController::RemoveBoids(uint num)
-{
-    int newsize = (int) Boids.size() - (int) num;
-    if (newsize > 0)
-    {
-        Boids.resize(newsize);
-        BoidData.resize(newsize);
-    }
-    else
-    {
-        Boids.clear();
-        BoidData.clear();
-    }
-}
-
-BoidController::GridPos BoidController::GetGridPosition(const PE::Vec3 & position)
+void BoidController::ReserveRegions(uint num_boids)
 {
-    uint x = uint(GRID_SIZE * (position.x + grid_offset) / grid_size);
-    uint y = uint(GRID_SIZE * (position.y + grid_offset) / grid_size);
-    uint z = uint(GRID_SIZE * (position.z + grid_offset) / grid_size);
-    return BoidController::GridPos{x, y, z};
-}
-
-static uint grid_positions_changed, boids_checked, boids_added, grids_checked;
-
-void BoidController::Update(float dt)
-{
-    if (Boids.empty())
-        return;
-    
-    if (OUT_NEIGHBOR_CHECK_INFO)
-    {
-        grids_checked = 0;
-        boids_checked = 0;
-        boids_added = 0;
-    }
-    for (uint i = 0; i < populates_per_frame; ++i)
-    {
-        populates_counter = (populates_counter + 1) % Boids.size();
-        PopulateNeighbors(Boids[populates_counter]);
-    }
-    if (OUT_NEIGHBOR_CHECK_INFO)
-    {
-        std::cout << (float) grids_checked / (float) populates_per_frame << ", ";
-        std::cout << (float) boids_checked / (float) populates_per_frame << ", ";
-        std::cout << (float) boids_added / (float) populates_per_frame << std::endl;
-    }
-    
-    for (uint i = 0; i < updates_per_frame; ++i)
-    {
-        updates_counter = (updates_counter + 1) % Boids.size();
-        UpdateForce(Boids[updates_counter]);
-    }
-    
-    for (uint i = 0; i < Boids.size(); ++i)
+    // Buffer storage can't be resized, so growing takes a new buffer. The old one is
+    // kept alive by the driver until the draws already issued from it are done.
+    glDeleteBuffers(1, &BoidDataBuffer);
+    for (GLsync & fence : region_fences)
     {
-        MoveBoid(Boids[i], dt);
-        UpdateTransform(Boids[i], BoidData[i]);
+        if (fence)
+            glDeleteSync(fence);
+        fence = nullptr;
     }
     
-    //grid_positions_changed = 0;
-    for (uint i = 0; i < grid_updates_per_frame; ++i)
-    {
-        grid_updates_counter = (grid_updates_counter + 1) % Boids.size();
-        UpdateGridPosition(grid_updates_counter);
-    }
-    //std::cout << (float)grid_positions_changed / (float)grid_updates_per_frame << std::endl;
-}
-
-void BoidController::PopulateGrid()
-{
-    // Clear all boids from the grid.
-    for (int x = 0; x < GRID_SIZE; ++x)
-        for (int y = 0; y < GRID_SIZE; ++y)
-            for (int z = 0; z < GRID_SIZE; ++z)
-                PositionGrid[x][y][z].clear();
-    
-    for (int i = 0; i < Boids.size(); ++i)
-    {
-        auto pos = GetGridPosition(Boids[i].position);
-        if (pos.x < GRID_SIZE && pos.y < GRID_SIZE && pos.z < GRID_SIZE)
-            PositionGrid[pos.x][pos.y][pos.z].emplace_back(i);
-    }
-}
-
-void BoidController::PopulateNeighbors(Boid & boid)
-{
-    boid.neighbors.clear();
-    
-    auto position = GetGridPosition(boid.position);
-    
-    // Check for neighbors in grid cubes near the boid's.
-    for (uint x = std::max((int) position.x - neighbor_search_distance, 0);
-         x < std::min(position.x + neighbor_search_distance, GRID_SIZE); ++x)
-        for (uint y = std::max((int) position.y - neighbor_search_distance, 0);
-             y < std::min(position.y + neighbor_search_distance, GRID_SIZE); ++y)
-            for (uint z = std::max((int) position.z - neighbor_search_distance, 0);
-                 z < std::min(position.z + neighbor_search_distance, GRID_SIZE); ++z)
-            {
-                if (OUT_NEIGHBOR_CHECK_INFO) ++grids_checked;
-                for (auto i : PositionGrid[x][y][z])
-                {
-                    float distance_squared = glm::distance2(boid.position, Boids[i].position);
-                    if (distance_squared < neighbor_dist_squared && distance_squared != 0)
-                    {
-                        boid.neighbors.emplace_back(i);
-                        if (OUT_NEIGHBOR_CHECK_INFO) ++boids_added;
-                    }
-                    if (OUT_NEIGHBOR_CHECK_INFO) ++boids_checked;
-                }
-            }
-    
-    for (uint feared_group = 0; feared_group < FearedBoids.size(); ++feared_group)
-    {
-        boid.fear_neighbors[feared_group].clear();
-        for (uint feared_boid = 0; feared_boid < FearedBoids[feared_group]->Boids.size(); ++feared_boid)
-        {
-            float distance_squared = glm::distance2(boid.position,
-                                                    FearedBoids[feared_group]->Boids[feared_boid].position);
-            if (distance_squared < fear_dist_squared && distance_squared != 0)
-                boid.fear_neighbors[feared_group].emplace_back(feared_boid);
-        }
-    }
-}
-
-void BoidController::UpdateForce(Boid & boid)
-{
-    PE::Vec3 avoid_force{}, align_force{}, cohesion_force{}, fear_force{};
-    if (!boid.neighbors.empty())
-    {
-        // Get forces from behaviors.
-        boid.force += avoid_force = AvoidVector(boid) * AvoidFactor;
-        boid.force += align_force = AlignVector(boid) * AlignFactor;
-        boid.force += cohesion_force = CohesionVector(boid) * CohesionFactor;
-    }
-    boid.force += fear_force = FearVector(boid) * FearFactor;
-    PE::Vec3 area_force = AreaVector(boid) * AreaFactor;
-    boid.force += area_force;
-    
-    // Can't normalize a 0 vector
-    if (boid.force != PE::Vec3{0})
-        boid.force = glm::normalize(boid.force);
-}
-
-void BoidController::MoveBoid(Boid & boid, float dt)
-{
-    // Add the force to shift the direction of the velocity toward where the boid
-    // wants to go, then scale that velocity to move speed.
-    boid.velocity += boid.force * TurnForce * dt;
-    boid.velocity = glm::normalize(boid.velocity) * boid.speed * Speed;
-    
-    if (ContinuousContainer && glm::length(boid.position) > area_size * 1.5f)
-        boid.position *= -1;
-    if (HardContainer && glm::length(boid.position) > area_size * 1.5f)
-        boid.position = glm::normalize(boid.position) * area_size * 1.5f;
+    // Leave room so a few more boids don't replace the buffer again.
+    region_capacity = num_boids + num_boids / 2;
+    GLsizeiptr size = INSTANCE_REGIONS * region_capacity * sizeof(BoidInstance);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &BoidDataBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, BoidDataBuffer);
+    glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+    mapped_instances = static_cast<BoidInstance *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    PE::Graphics::LogError(__FILE__, __LINE__);
     
-    // Update position.
-    boid.position += boid.velocity * dt;
-}
-
-void BoidController::UpdateGridPosition(uint boid_index)
-{
-    auto & boid = Boids[boid_index];
-    GridPos new_pos = GetGridPosition(boid.position);
-    if (new_pos != boid.grid_position && new_pos.x < GRID_SIZE && new_pos.y < GRID_SIZE && new_pos.z < GRID_SIZE)
+    // Orphaning needs a buffer whose storage can be replaced.
+    if (!mapped_instances)
     {
-        // Remove boid from old position.
-        auto & v = PositionGrid[boid.grid_position.x][boid.grid_position.y][boid.grid_position.z];
-        v.erase(std::remove(v.begin(), v.end(), boid_index), v.end());
-        
-        // Add to new position.
-        PositionGrid[new_pos.x][new_pos.y][new_pos.z].emplace_back(boid_index);
-        boid.grid_position = new_pos;
-        
+        persistent_mapping = false;
+        region_capacity = 0;
+        glDeleteBuffers(1, &BoidDataBuffer);
+        glGenBuffers(1, &BoidDataBuffer);
     }
+    BindInstanceBuffer();
 }
 
-void BoidController::UpdateTransform(const Boid & boid, PE::Mat4 & boid_render_info)
-{
-    // Update boid transform to new position and heading.
-    // Using boid position as "Up" vector means up is always away from the center.
-    boid_render_info = glm::translate(boid.position) *
-                       glm::transpose(glm::lookAt(PE::Vec3{}, boid.velocity, boid.position)) *
-                       glm::scale(BoidScale);
-}
-
-PE::Vector RandomVec()
-{
-    static DieReal VelDie(-1.f, 1.f);
-    return PE::Vector{VelDie.Roll(), VelDie.Roll(), VelDie.Roll()};
-}
-
-BoidController::Boid BoidController::MakeBoid()
-{
-    // Random generators for use in this function only.
-    static DieReal PosDie(-1, 1);
-    static DieReal SpeedDie(1, 2);
-    
-    // Create boid with random location and velocity.
-    Boid NewBoid;
-    NewBoid.position = PE::Vector{PosDie.Roll(), PosDie.Roll(), PosDie.Roll()} * area_size;
-    NewBoid.velocity = RandomVec();
-    NewBoid.velocity = glm::normalize(NewBoid.velocity);
-    NewBoid.speed = SpeedDie.Roll();
-    NewBoid.fear_neighbors.resize(FearedBoids.size());
-    return NewBoid;
-}
-
-void BoidController::AddFearedBoids(const BoidController * feared_boids)
+void BoidController::WaitForRegion(uint region)
 {
-    // Avoid adding the same boids twice.
-    for (auto * b : FearedBoids)
-        if (b == feared_boids)
-            return;
-    
-    FearedBoids.emplace_back(feared_boids);
-    // Since we added a new group of feared boids, we need to add a spot for it to each boid's list.
-    for (auto & b : Boids)
-        b.fear_neighbors.emplace_back(std::vector<uint>());
-}
-
-void BoidController::RemoveFearedBoids(const BoidController * removed_fear)
-{
-    int remove_index = -1;
-    for (uint i = 0; i < FearedBoids.size(); ++i)
-        if (FearedBoids[i] == removed_fear)
-        {
-            remove_index = i;
-            break;
-        }
-    
-    // Cant remove something not on the list.
-    if (remove_index == -1)
+    GLsync & fence = region_fences[region];
+    if (!fence)
         return;
     
-    // Remove feared boids from controller and each boids' neighbor list.
-    FearedBoids.erase(FearedBoids.begin() + remove_index);
-    for (auto & b : Boids)
-        b.fear_neighbors.erase(b.fear_neighbors.begin() + remove_index);
-}
-
-void BoidController::SetFearDistance(float distance)
-{
-    fear_dist_squared = distance * distance;
-}
-
-void BoidController::SetNeighborDistance(float distance)
-{
-    neighbor_dist_squared = distance * distance;
-    UpdateNeighborSearchDistance();
-}
-
-void BoidController::SetAreaSize(float size)
-{
-    area_size = size;
-    grid_offset = size * 1.2f;
-    grid_size = size * 2.4f;
-    
-    UpdateNeighborSearchDistance();
+    PE::TraceZone zone("Wait for instance region");
+    // Flush on the first try, or the fence might never be sent to the GPU.
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (glClientWaitSync(fence, flags, REGION_WAIT_TIMEOUT) == GL_TIMEOUT_EXPIRED)
+        flags = 0;
+    glDeleteSync(fence);
+    fence = nullptr;
 }
 
-void BoidController::UpdateNeighborSearchDistance()
+void BoidController::UpdateRenderData(float alpha)
 {
-    float distance = std::sqrt(neighbor_dist_squared);
-    float grid_width = (grid_size / (float) GRID_SIZE);
-    neighbor_search_distance = static_cast<int>(std::floor(distance / grid_width));
-}
-
-
-//----------------------------------------------------------------------------------------------------------------------
-// Behavior code.
-
-PE::Vector BoidController::AvoidVector(const Boid & boid) const
-{
-    PE::Vector bVector{};
+    uint num_boids = GetNumBoids();
+    num_instances = static_cast<GLsizei>(num_boids);
+    if (persistent_mapping && num_boids > region_capacity)
+        ReserveRegions(num_boids);
     
-    for (auto i : boid.neighbors)
+    if (!persistent_mapping)
     {
-        float dist = glm::distance2(Boids[i].position, boid.position);
-        if (dist != 0.f)
-            bVector += (boid.position - Boids[i].position) / dist;
+        BoidData.resize(num_boids);
+        BuildInstances(alpha, BoidData.data());
+        return;
     }
-    return bVector;
-}
-
-PE::Vector BoidController::AlignVector(const Boid & boid) const
-{
-    PE::Vector bVector{};
-    
-    for (auto i : boid.neighbors)
-        bVector += Boids[i].velocity;
-    
-    bVector = glm::normalize(bVector);
-    return bVector;
-}
-
-PE::Vector BoidController::CohesionVector(const Boid & boid) const
-{
-    PE::Vector bVector{};
-    
-    for (auto i : boid.neighbors)
-        bVector += Boids[i].position - boid.position;
     
-    bVector = glm::normalize(bVector);
-    return bVector;
+    // The next region was last drawn from two frames ago, so its fence has usually passed.
+    current_region = (current_region + 1) % INSTANCE_REGIONS;
+    WaitForRegion(current_region);
+    BuildInstances(alpha, mapped_instances + current_region * region_capacity);
 }
 
-PE::Vector BoidController::FearVector(const BoidController::Boid & boid) const
+void BoidController::UpdateView()
 {
-    PE::Vector bVector{};
-    
-    // For each group of feared boids, calculate for each neighboring boid from that group.
-    for (uint feared_group = 0; feared_group < boid.fear_neighbors.size(); ++feared_group)
-        for (uint feared_boid = 0; feared_boid < boid.fear_neighbors[feared_group].size(); ++feared_boid)
-        {
-            auto other = FearedBoids[feared_group]->Boids[feared_boid];
-            float dist2 = glm::distance2(other.position, boid.position);
-            if (dist2 != 0.f)
-                bVector += (boid.position - other.position) / dist2;
-        }
-    
-    // We don't know if there were any feared boids in range, so we have to check for a 0 vector.
-    //if (bVector != PE::Vec3{0})
-    //    bVector = glm::normalize(bVector);
-    
-    return bVector;
-}
-
-PE::Vector BoidController::AreaVector(const Boid & boid) const
-{
-    // Gently nudge boids in if they get too far
-    return -boid.position * std::max((glm::length(boid.position) - area_size), 0.0f);
+    // Boids are simulated in the model's space, so bring the camera into it.
+    PE::Graphics * graphics = PE::Graphics::GetInstance();
+    SimView view;
+    view.position = glm::inverse(GetTransform()) * PE::Vec4(graphics->cam_position, 1);
+    view.view_projection = graphics->projection * graphics->view * GetTransform();
+    view.has_frustum = true;
+    SetView(view);
 }
 
 //----------------------------------------------------------------------------------------------------------------------
@@ -414,7 +154,7 @@ void BoidController::DrawDebug(PE::Shader * shader, const PE::Mat4 & projection,
         PE::Graphics::LogError(__FILE__, __LINE__);
         
         // Draw each boid using it's individual position and rotation.
-        for (const Boid & boid : Boids)
+        for (uint boid = 0; boid < GetNumBoids(); ++boid)
         {
             glUniformMatrix4fv(shader->uTransform, 1, GL_FALSE, glm::value_ptr(transform_final));
             glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, nullptr);
@@ -437,7 +177,7 @@ void BoidController::DrawDebugLines(PE::Shader * shader, const PE::Mat4 & projec
         PE::Graphics::LogError(__FILE__, __LINE__);
         
         // Draw each boid.
-        for (const Boid & boid : Boids)
+        for (uint boid = 0; boid < GetNumBoids(); ++boid)
         {
             glUniformMatrix4fv(shader->uTransform, 1, GL_FALSE, glm::value_ptr(transform_final));
             glDrawElements(GL_LINE_STRIP, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, nullptr);
@@ -451,16 +191,31 @@ void BoidController::DrawDeferred(const PE::Shader * shader, const PE::Mat4 & pr
 {
     PE::Mat4 transform = projection * GetTransform();
     
-    glBindBuffer(GL_ARRAY_BUFFER, BoidDataBuffer);
-    glBufferData(GL_ARRAY_BUFFER, Boids.size() * sizeof(glm::mat4), &BoidData[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Draw what the last render data update built, boids added since then show up next frame.
+    GLsizei num_boids = num_instances;
+    
+    // A mapped buffer already holds the data in the current region.
+    GLuint first_instance = 0;
+    if (persistent_mapping)
+        first_instance = current_region * region_capacity;
+    else
+    {
+        PE::TraceZone zone("Upload instances");
+        // Orphan the old storage rather than wait on draws still reading it.
+        GLsizeiptr size = num_boids * sizeof(BoidInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, BoidDataBuffer);
+        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, BoidData.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
     
     PE::Mat4 model_inverse = glm::transpose(glm::inverse(GetTransform()));
     glUniformMatrix4fv(shader->uTransform, 1, GL_FALSE, glm::value_ptr(transform));
+    glUniform3fv(shader->uInstanceScale, 1, glm::value_ptr(BoidScale));
     
     // Break boids into batches, one for each material type.
-    GLsizei batch_size = Boids.size() / (BoidMaterials.size() + 1);
-    GLsizei final_batch_size = Boids.size() - (batch_size * (BoidMaterials.size()));
+    GLsizei batch_size = num_boids / (BoidMaterials.size() + 1);
+    GLsizei final_batch_size = num_boids - (batch_size * (BoidMaterials.size()));
     
     // Draw boids one material at a time.
     for (int i = 0; i < BoidMaterials.size(); ++i)
@@ -480,29 +235,29 @@ void BoidController::DrawDeferred(const PE::Shader * shader, const PE::Mat4 & pr
             // Draw all boids at once.
             if (&mesh == &GetMeshes().back())
                 glDrawElementsInstancedBaseInstance(GL_TRIANGLES, (GLsizei) mesh.indices.size(),
-                                                    GL_UNSIGNED_INT, nullptr, final_batch_size, i * batch_size);
+                                                    GL_UNSIGNED_INT, nullptr, final_batch_size,
+                                                    first_instance + i * batch_size);
             else
                 glDrawElementsInstancedBaseInstance(GL_TRIANGLES, (GLsizei) mesh.indices.size(),
-                                                    GL_UNSIGNED_INT, nullptr, batch_size, i * batch_size);
+                                                    GL_UNSIGNED_INT, nullptr, batch_size,
+                                                    first_instance + i * batch_size);
             PE::Graphics::LogError(__FILE__, __LINE__);
             
             glBindVertexArray(0);
         }
     }
     
+    // Keep the region from being written again until these draws are done with it.
+    if (persistent_mapping)
+    {
+        if (region_fences[current_region])
+            glDeleteSync(region_fences[current_region]);
+        region_fences[current_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    
     PE::Graphics::LogError(__FILE__, __LINE__);
 }
 
-uint BoidController::GetNumBoids() const
-{
-    return Boids.size();
-}
-
-float BoidController::GetAreaSize() const
-{
-    return area_size;
-}
-
 void BoidController::AddBoidMaterial(PE::Material new_material)
 {
     BoidMaterials.push_back(new_material);
@@ -513,12 +268,14 @@ void BoidController::ClearBoidMaterials()
     BoidMaterials.clear();
 }
 
-bool BoidController::GridPos::operator==(const BoidController::GridPos & other)
-{
-    return x == other.x && y == other.y && z == other.z;
-}
-
-bool BoidController::GridPos::operator!=(const BoidController::GridPos & other)
+std::vector<uint> BoidController::GetOrderBatchStarts() const
 {
-    return !((*this) == other);
+    // Materials are drawn in contiguous batches of boids, keeping boids in
+    // their batch keeps every boid the same color.
+    uint batch_size = GetNumBoids() / (BoidMaterials.size() + 1);
+    std::vector<uint> batch_starts;
+    for (uint i = 0; i < BoidMaterials.size(); ++i)
+        batch_starts.emplace_back(i * batch_size);
+    batch_starts.emplace_back(BoidMaterials.size() * batch_size);
+    return batch_starts;
 }
@@ -1,45 +1,30 @@
 #pragma once
 
 #include <vector>
-#include <array>
 #include "Engine/Types.h"
 #include "Engine/Transformable.h"
 #include "Engine/Model.h"
+#include "BoidSim.h"
 
-const uint GRID_SIZE = 256;
-
-class BoidController : public PE::Model
+/*!
+@brief A group of boids in the scene. Runs the flocking simulation and
+   draws every boid as an instance of the model.
+*/
+class BoidController : public PE::Model, public BoidSim
 {
-    struct GridPos
-    {
-        uint x, y, z;
-        bool operator==(const GridPos & other);
-        bool operator!=(const GridPos & other);
-    };
-    
-    struct Boid
-    {
-        PE::Vector position{};
-        PE::Vector velocity{};
-        PE::Vector force{};
-        // Store neighbors by index to avoid
-        // pointer invalidation when adding boids.
-        std::vector<uint> neighbors;
-        std::vector<std::vector<uint>> fear_neighbors;
-        float speed{1};
-        GridPos grid_position{0, 0, 0};
-    };
-
 public:
     explicit BoidController(std::string_view path);
+    ~BoidController();
     
     void AddBoidMaterial(PE::Material new_material);
     void ClearBoidMaterials();
     
-    void AddBoids(uint num);
-    void RemoveBoids(uint num);
+    // Rebuilds the instance data alpha of the way from the previous tick to the latest one,
+    // writing it straight into the instance buffer when it can stay mapped.
+    void UpdateRenderData(float alpha);
     
-    void Update(float dt);
+    // Points the simulation's level of detail at the camera.
+    void UpdateView();
     
     void DrawDebug(PE::Shader * shader, const PE::Mat4 & projection,
                    const PE::Color * color) override;
@@ -51,75 +36,38 @@ public:
                       const PE::Mat4 & projection,
                       const PE::Vec3 & cam_position) override;
     
-    // Behavior attributes.
-    float AvoidFactor = 1;
-    float AlignFactor = 1;
-    float CohesionFactor = 1;
-    float AreaFactor = 1;
-    float FearFactor = 1;
-    
-    float Speed = 1;
-    float TurnForce = 1;
     PE::Vec3 BoidScale{1};
     
-    bool HardContainer = true;
-    bool ContinuousContainer = false;
+protected:
+    [[nodiscard]] std::vector<uint> GetOrderBatchStarts() const override;
+    
+private:
+    // Frames of instance data the buffer holds, so the GPU can draw from one while the next is written.
+    static const uint INSTANCE_REGIONS = 3;
     
-    // How many boids should recalculate their heading each frame.
-    uint updates_per_frame = 1000;
+    // Points the instance attributes of every mesh at BoidDataBuffer.
+    void BindInstanceBuffer();
     
-    // How many boids should recalculate their grid position each frame.
-    uint grid_updates_per_frame = 1000;
+    // Replaces the mapped buffer with one that has room for num_boids in each region.
+    void ReserveRegions(uint num_boids);
     
-    // How mant boids should repopulate their neighbor list each frame.
-    uint populates_per_frame = 1000;
+    // Waits until the GPU is done drawing from a region so it can be written again.
+    void WaitForRegion(uint region);
     
-    void AddFearedBoids(const BoidController * feared_boids);
-    void RemoveFearedBoids(const BoidController * removed_fear);
-    void SetFearDistance(float distance);
-    void SetNeighborDistance(float distance);
-    void SetAreaSize(float size);
-    float GetAreaSize() const;
-    uint GetNumBoids() const;
-private:
-    Boid MakeBoid();
-    void PopulateGrid();
-    void PopulateNeighbors(Boid & boid);
-    void UpdateForce(Boid & boid);
-    void MoveBoid(Boid & boid, float dt);
-    void UpdateGridPosition(uint boid_index);
-    void UpdateTransform(const Boid & boid, PE::Mat4 & boid_render_info);
-    
-    [[nodiscard]] PE::Vector AvoidVector(const Boid & boid) const;
-    [[nodiscard]] PE::Vector AlignVector(const Boid & boid) const;
-    [[nodiscard]] PE::Vector CohesionVector(const Boid & boid) const;
-    [[nodiscard]] PE::Vector FearVector(const Boid & boid) const;
-    [[nodiscard]] PE::Vector AreaVector(const Boid & boid) const;
-    
-    GridPos GetGridPosition(const PE::Vec3 & position);
-    void UpdateNeighborSearchDistance();
-    
-    // The size of area boids try to stay within.
-    float area_size = 10;
-    float grid_offset = 0;
-    float grid_size = 0;
-    float neighbor_dist_squared = 1;
-    int neighbor_search_distance = 1;
-    float fear_dist_squared = 25;
-    
-    std::vector<const BoidController *> FearedBoids;
-    std::vector<Boid> Boids;
-    std::vector<PE::Mat4> BoidData;
+    // Instance data to upload, only used when the buffer can't stay mapped.
+    std::vector<BoidInstance> BoidData;
     std::vector<PE::Material> BoidMaterials;
     
-    // 3d array that represents position in space, with each vector
-    // containing the IDs of the boids within that section.
-    std::array<std::array<std::array<std::vector<uint>,
-            GRID_SIZE>, GRID_SIZE>, GRID_SIZE> PositionGrid;
-    
     GLuint BoidDataBuffer = 0;
     
-    uint populates_counter = 0;
-    uint updates_counter = 0;
-    uint grid_updates_counter = 0;
+    // With persistent mapping the buffer is split into regions written in turn, each
+    // fenced after it is drawn from. Otherwise it is orphaned and refilled every frame.
+    bool persistent_mapping = false;
+    BoidInstance * mapped_instances = nullptr;
+    uint region_capacity = 0;
+    uint current_region = 0;
+    GLsync region_fences[INSTANCE_REGIONS] = {};
+    
+    // Boids in the last render data update.
+    GLsizei num_instances = 0;
 };
@@ -0,0 +1,289 @@
+// Times each phase of the simulation on its own across a sweep of boid
+// counts, neighbor distances and densities, and prints the results as JSON.
+// Usage:
+//   boids_bench [--counts N,N,...] [--distances D,D,...] [--densities P,P,...]
+//               [--ticks T] [--threads N] [--morton INTERVAL] [--unbounded] [--seed S]
+//
+// Density is boids per cubic unit of the spawn area. Every phase processes
+// every boid each tick, so per-boid costs don't depend on the per-frame budgets.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "BoidSim.h"
+#include "BoidKernels.h"
+#include "Engine/Random.h"
+#include "Engine/ThreadPool.h"
+
+// Aim for about this many boid-ticks per configuration when --ticks isn't given.
+static const double AUTO_BOID_TICKS = 2000000;
+static const uint MIN_AUTO_TICKS = 2;
+static const uint MAX_AUTO_TICKS = 50;
+static const uint WARMUP_TICKS = 2;
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions
+{
+    std::vector<uint> counts{1000, 10000, 100000, 1000000};
+    std::vector<float> distances{1, 2, 4};
+    std::vector<float> densities{0.03f, 0.1f, 0.3f};
+    uint ticks = 0;
+    uint threads = 0;
+    uint morton_interval = 0;
+    bool unbounded = false;
+    std::uint64_t seed = 1;
+};
+
+// Per-boid results for one configuration.
+struct BenchResult
+{
+    uint boids = 0;
+    float distance = 0;
+    float density = 0;
+    float area = 0;
+    uint ticks = 0;
+
+    // Nanoseconds per boid per tick.
+    double populate = 0;
+    double force = 0;
+    double move = 0;
+    double transform = 0;
+    double grid_update = 0;
+    double populate_grid = 0;
+
+    double neighbors = 0;
+    double cells_scanned = 0;
+    double candidates = 0;
+};
+
+static void PrintUsage()
+{
+    std::fprintf(stderr, "usage: boids_bench [--counts N,N,...] [--distances D,D,...] [--densities P,P,...]\n"
+                         "                   [--ticks T] [--threads N] [--morton INTERVAL] [--unbounded] [--seed S]\n");
+}
+
+template<typename T>
+static bool ParseList(const char * value, std::vector<T> & out)
+{
+    out.clear();
+    std::string list = value;
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+
+        double parsed = std::strtod(list.substr(start, end - start).c_str(), nullptr);
+        if (parsed <= 0)
+            return false;
+        out.emplace_back(static_cast<T>(parsed));
+        start = end + 1;
+    }
+    return !out.empty();
+}
+
+static bool ParseOptions(int argc, char * argv[], BenchOptions & options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--unbounded")
+        {
+            options.unbounded = true;
+            continue;
+        }
+
+        // Everything else takes a value.
+        if (i + 1 >= argc)
+            return false;
+        const char * value = argv[++i];
+
+        if (arg == "--counts")
+        {
+            if (!ParseList(value, options.counts))
+                return false;
+        }
+        else if (arg == "--distances")
+        {
+            if (!ParseList(value, options.distances))
+                return false;
+        }
+        else if (arg == "--densities")
+        {
+            if (!ParseList(value, options.densities))
+                return false;
+        }
+        else if (arg == "--ticks")
+            options.ticks = static_cast<uint>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--threads")
+            options.threads = static_cast<uint>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--morton")
+            options.morton_interval = static_cast<uint>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--seed")
+            options.seed = std::strtoull(value, nullptr, 10);
+        else
+            return false;
+    }
+    return true;
+}
+
+static double ElapsedMs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static BenchResult RunConfig(const BenchOptions & options, uint count, float distance, float density)
+{
+    BenchResult result;
+    result.boids = count;
+    result.distance = distance;
+    result.density = density;
+
+    // Boids spawn in a cube twice the area size across.
+    result.area = 0.5f * std::cbrt(count / density);
+    result.ticks = options.ticks;
+    if (result.ticks == 0)
+        result.ticks = std::clamp(static_cast<uint>(AUTO_BOID_TICKS / count), MIN_AUTO_TICKS, MAX_AUTO_TICKS);
+
+    BoidSim sim;
+    sim.AvoidFactor = 0.25f;
+    sim.AlignFactor = 1;
+    sim.CohesionFactor = 1;
+    sim.AreaFactor = 1.f / 2000.f;
+    sim.SetAreaSize(result.area);
+    sim.SetNeighborDistance(distance);
+    sim.SetGridMode(options.unbounded ? GridMode::Unbounded : GridMode::Bounded);
+    sim.MortonSortInterval = options.morton_interval;
+
+    // Same boids for a given count no matter where in the sweep it runs.
+    sim.SpawnStream = 0;
+    sim.AddBoids(count);
+
+    // Run every phase over every boid, after AddBoids picked its own budgets.
+    sim.updates_per_frame = count;
+    sim.grid_updates_per_frame = count;
+    sim.populates_per_frame = count;
+
+    float dt = 1.f / 60.f;
+    std::vector<BoidInstance> instances(count);
+
+    // Fill the neighbor lists and fault in all the staging memory first.
+    for (uint tick = 0; tick < WARMUP_TICKS; ++tick)
+    {
+        sim.Update(dt);
+        sim.BuildInstances(0.5f, instances.data());
+    }
+
+    SimPhaseTimes phases;
+    SimCounters counters;
+    double transform_ms = 0, populate_grid_ms = 0;
+    for (uint tick = 0; tick < result.ticks; ++tick)
+    {
+        sim.Update(dt);
+        const SimPhaseTimes & tick_phases = sim.GetPhaseTimes();
+        phases.populate += tick_phases.populate;
+        phases.force += tick_phases.force;
+        phases.move += tick_phases.move;
+        phases.grid += tick_phases.grid;
+
+        const SimCounters & tick_counters = sim.GetCounters();
+        counters.populated += tick_counters.populated;
+        counters.cells_scanned += tick_counters.cells_scanned;
+        counters.candidates_checked += tick_counters.candidates_checked;
+        counters.neighbors_found += tick_counters.neighbors_found;
+
+        Clock::time_point start = Clock::now();
+        sim.BuildInstances(0.5f, instances.data());
+        transform_ms += ElapsedMs(start);
+
+        start = Clock::now();
+        sim.PopulateGrid();
+        populate_grid_ms += ElapsedMs(start);
+    }
+
+    double boid_ticks = static_cast<double>(count) * result.ticks;
+    result.populate = phases.populate * 1e6 / boid_ticks;
+    result.force = phases.force * 1e6 / boid_ticks;
+    result.move = phases.move * 1e6 / boid_ticks;
+    result.transform = transform_ms * 1e6 / boid_ticks;
+    result.grid_update = phases.grid * 1e6 / boid_ticks;
+    result.populate_grid = populate_grid_ms * 1e6 / boid_ticks;
+
+    if (counters.populated)
+    {
+        double populated = static_cast<double>(counters.populated);
+        result.neighbors = counters.neighbors_found / populated;
+        result.cells_scanned = counters.cells_scanned / populated;
+        result.candidates = counters.candidates_checked / populated;
+    }
+    return result;
+}
+
+static void PrintResult(const BenchResult & result, bool last)
+{
+    std::printf("    {\n");
+    std::printf("      \"boids\": %u,\n", result.boids);
+    std::printf("      \"neighbor_distance\": %g,\n", result.distance);
+    std::printf("      \"density\": %g,\n", result.density);
+    std::printf("      \"area_size\": %g,\n", result.area);
+    std::printf("      \"ticks\": %u,\n", result.ticks);
+    std::printf("      \"ns_per_boid\": {\n");
+    std::printf("        \"populate_neighbors\": %.3f,\n", result.populate);
+    std::printf("        \"update_force\": %.3f,\n", result.force);
+    std::printf("        \"move_boid\": %.3f,\n", result.move);
+    std::printf("        \"update_transform\": %.3f,\n", result.transform);
+    std::printf("        \"move_and_transform\": %.3f,\n", result.move + result.transform);
+    std::printf("        \"update_grid_position\": %.3f,\n", result.grid_update);
+    std::printf("        \"populate_grid\": %.3f\n", result.populate_grid);
+    std::printf("      },\n");
+    std::printf("      \"neighbors_per_boid\": %.3f,\n", result.neighbors);
+    std::printf("      \"cells_scanned_per_boid\": %.3f,\n", result.cells_scanned);
+    std::printf("      \"candidates_per_boid\": %.3f\n", result.candidates);
+    std::printf("    }%s\n", last ? "" : ",");
+}
+
+int main(int argc, char * argv[])
+{
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    PE::SetRandomSeed(options.seed);
+    PE::ThreadPool::GetInstance().SetNumThreads(options.threads);
+
+    std::printf("{\n");
+    std::printf("  \"kernels\": \"%s\",\n", GetBoidKernels().name);
+    std::printf("  \"threads\": %u,\n", PE::ThreadPool::GetInstance().GetNumThreads());
+    std::printf("  \"grid\": \"%s\",\n", options.unbounded ? "unbounded" : "bounded");
+    std::printf("  \"morton_interval\": %u,\n", options.morton_interval);
+    std::printf("  \"seed\": %llu,\n", static_cast<unsigned long long>(options.seed));
+    std::printf("  \"results\": [\n");
+
+    size_t total = options.counts.size() * options.distances.size() * options.densities.size();
+    size_t run = 0;
+    for (uint count : options.counts)
+        for (float distance : options.distances)
+            for (float density : options.densities)
+            {
+                // Progress goes to stderr so stdout stays valid JSON.
+                ++run;
+                std::fprintf(stderr, "[%zu/%zu] %u boids, distance %g, density %g\n", run, total, count, distance,
+                             density);
+                PrintResult(RunConfig(options, count, distance, density), run == total);
+                std::fflush(stdout);
+            }
+
+    std::printf("  ]\n");
+    std::printf("}\n");
+    return 0;
+}
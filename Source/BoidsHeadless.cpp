@@ -0,0 +1,336 @@
+// Runs the flocking simulation with no window or GPU and reports how long
+// each phase of a tick takes. Usage:
+//   boids_headless [--boids N] [--predators N] [--ticks T] [--threads N]
+//                  [--tick-rate HZ] [--neighbor-distance D] [--area SIZE]
+//                  [--morton INTERVAL] [--unbounded] [--seed S] [--churn N]
+//                  [--target-ms MS] [--max-staleness SECONDS] [--verlet SKIN] [--nearest K]
+//                  [--long-range D] [--opening-angle A] [--lod D]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "BoidSim.h"
+#include "BoidKernels.h"
+#include "Engine/Random.h"
+#include "Engine/ThreadPool.h"
+
+struct HeadlessOptions
+{
+    uint boids = 50000;
+    uint predators = 10;
+    uint ticks = 600;
+    uint threads = 0;
+    float tick_rate = 60;
+    float neighbor_distance = 2;
+    float area = 60;
+    uint morton_interval = 300;
+    bool unbounded = false;
+    std::uint64_t seed = 1;
+    uint churn = 0;
+    float target_ms = 0;
+    float max_staleness = 2;
+    float verlet_skin = 0;
+    uint nearest = 0;
+    float long_range = 0;
+    float opening_angle = 0.5f;
+    float lod_distance = 0;
+};
+
+// Random stream picking which boids churn replaces, clear of the ones sims spawn from.
+static const std::uint64_t CHURN_STREAM = ~std::uint64_t{0};
+
+// Level of detail is seen from where the interactive build's camera starts, on a 16:9 screen.
+static const PE::Vec3 CAMERA_POSITION{24, 24, 24};
+static const PE::Vec3 CAMERA_TARGET{0, 0, 0};
+static const float CAMERA_FOV_DEGREES = 45;
+static const float CAMERA_ASPECT = 16.f / 9.f;
+static const float CAMERA_NEAR = 0.1f;
+static const float CAMERA_FAR = 1000;
+
+static void PrintUsage()
+{
+    std::printf("usage: boids_headless [--boids N] [--predators N] [--ticks T] [--threads N]\n"
+                "                      [--tick-rate HZ] [--neighbor-distance D] [--area SIZE]\n"
+                "                      [--morton INTERVAL] [--unbounded] [--seed S] [--churn N]\n"
+                "                      [--target-ms MS] [--max-staleness SECONDS] [--verlet SKIN] [--nearest K]\n"
+                "                      [--long-range D] [--opening-angle A] [--lod D]\n");
+}
+
+static bool ParseOptions(int argc, char * argv[], HeadlessOptions & options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--unbounded")
+        {
+            options.unbounded = true;
+            continue;
+        }
+
+        // Everything else takes a value.
+        if (i + 1 >= argc)
+            return false;
+        const char * value = argv[++i];
+
+        if (arg == "--boids")
+            options.boids = static_cast<uint>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--predators")
+            options.predators = static_cast<uint>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--ticks")
+            options.ticks = static_cast<uint>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--threads")
+            options.threads = static_cast<uint>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--tick-rate")
+            options.tick_rate = std::strtof(value, nullptr);
+        else if (arg == "--neighbor-distance")
+            options.neighbor_distance = std::strtof(value, nullptr);
+        else if (arg == "--area")
+            options.area = std::strtof(value, nullptr);
+        else if (arg == "--morton")
+            options.morton_interval = static_cast<uint>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--seed")
+            options.seed = std::strtoull(value, nullptr, 10);
+        else if (arg == "--churn")
+            options.churn = static_cast<uint>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--target-ms")
+            options.target_ms = std::strtof(value, nullptr);
+        else if (arg == "--max-staleness")
+            options.max_staleness = std::strtof(value, nullptr);
+        else if (arg == "--verlet")
+            options.verlet_skin = std::strtof(value, nullptr);
+        else if (arg == "--nearest")
+            options.nearest = static_cast<uint>(std::strtoul(value, nullptr, 10));
+        else if (arg == "--long-range")
+            options.long_range = std::strtof(value, nullptr);
+        else if (arg == "--opening-angle")
+            options.opening_angle = std::strtof(value, nullptr);
+        else if (arg == "--lod")
+            options.lod_distance = std::strtof(value, nullptr);
+        else
+            return false;
+    }
+    return options.tick_rate > 0 && options.neighbor_distance > 0 && options.area > 0;
+}
+
+// Same setup as the two boid types in the interactive build.
+static void SetupGroup(BoidSim & sim, const HeadlessOptions & options, float fear_factor, uint count)
+{
+    sim.AvoidFactor = 0.25f;
+    sim.AlignFactor = 1;
+    sim.CohesionFactor = 1;
+    sim.AreaFactor = 1.f / 2000.f;
+    sim.FearFactor = fear_factor;
+    sim.SetAreaSize(options.area);
+    sim.SetNeighborDistance(options.neighbor_distance);
+    sim.SetGridMode(options.unbounded ? GridMode::Unbounded : GridMode::Bounded);
+    sim.MortonSortInterval = options.morton_interval;
+    sim.Scheduler.TargetMs = options.target_ms;
+    sim.Scheduler.MaxStaleness = options.max_staleness;
+    sim.LongRangeDistance = options.long_range;
+    sim.OpeningAngle = options.opening_angle;
+    sim.LodDistance = options.lod_distance;
+    if (options.lod_distance > 0)
+    {
+        SimView view;
+        view.position = CAMERA_POSITION;
+        view.view_projection = glm::perspective(glm::radians(CAMERA_FOV_DEGREES), CAMERA_ASPECT, CAMERA_NEAR,
+                                                CAMERA_FAR) *
+                               glm::lookAt(CAMERA_POSITION, CAMERA_TARGET, PE::Vec3{0, 1, 0});
+        view.has_frustum = true;
+        sim.SetView(view);
+    }
+    if (options.verlet_skin > 0)
+    {
+        sim.SetVerletSkin(options.verlet_skin);
+        sim.SetNeighborMode(NeighborMode::Verlet);
+    }
+    else if (options.nearest > 0)
+    {
+        sim.SetNeighborCount(options.nearest);
+        sim.SetNeighborMode(NeighborMode::KNearest);
+    }
+    sim.AddBoids(count);
+}
+
+static void AddTimes(SimPhaseTimes & total, const SimPhaseTimes & tick)
+{
+    total.reorder += tick.reorder;
+    total.tree += tick.tree;
+    total.populate += tick.populate;
+    total.long_range += tick.long_range;
+    total.force += tick.force;
+    total.move += tick.move;
+    total.grid += tick.grid;
+}
+
+// Budgets summed over a run, wide enough for long runs of large groups.
+struct BudgetTotals
+{
+    std::uint64_t updates = 0;
+    std::uint64_t grid_updates = 0;
+    std::uint64_t populates = 0;
+};
+
+static void AddBudgets(BudgetTotals & total, const BoidSim & sim)
+{
+    total.updates += sim.updates_per_frame;
+    total.grid_updates += sim.grid_updates_per_frame;
+    total.populates += sim.populates_per_frame;
+}
+
+static void PrintBudgets(const char * name, const BudgetTotals & total, uint ticks)
+{
+    std::printf("%-10s %10.0f %10.0f %10.0f\n", name, double(total.populates) / ticks,
+                double(total.updates) / ticks, double(total.grid_updates) / ticks);
+}
+
+// Neighbor lists gathered over a run, and how stale they got.
+struct ListTotals
+{
+    std::uint64_t gathered = 0;
+    double mean_age_sum = 0;
+    uint max_age = 0;
+    float max_drift = 0;
+};
+
+static void AddLists(ListTotals & total, const BoidSim & sim)
+{
+    total.gathered += sim.GetCounters().populated;
+    const SimStaleness & staleness = sim.GetStaleness();
+    total.mean_age_sum += staleness.mean_age;
+    total.max_age = std::max(total.max_age, staleness.max_age);
+    total.max_drift = std::max(total.max_drift, staleness.max_drift);
+}
+
+static void PrintLists(const char * name, const ListTotals & total, uint ticks, bool verlet)
+{
+    if (verlet)
+        std::printf("%-10s %10.0f %10.2f %10u %10.3f\n", name, double(total.gathered) / ticks,
+                    total.mean_age_sum / ticks, total.max_age, total.max_drift);
+    else
+        std::printf("%-10s %10.0f\n", name, double(total.gathered) / ticks);
+}
+
+// Headings updated and boids out of sight over a run with level of detail.
+struct LodTotals
+{
+    std::uint64_t updated = 0;
+    std::uint64_t out_of_sight = 0;
+};
+
+static void AddLod(LodTotals & total, const BoidSim & sim)
+{
+    total.updated += sim.GetLodStats().updated;
+    total.out_of_sight += sim.GetLodStats().out_of_sight;
+}
+
+static void PrintLod(const char * name, const LodTotals & total, uint ticks)
+{
+    std::printf("%-10s %10.0f %12.0f\n", name, double(total.updated) / ticks, double(total.out_of_sight) / ticks);
+}
+
+static void PrintTimes(const char * name, const SimPhaseTimes & total, uint ticks, uint boids)
+{
+    double sum = total.reorder + total.tree + total.populate + total.long_range + total.force + total.move +
+                 total.grid;
+    std::printf("%-10s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %12.1f\n", name,
+                total.reorder / ticks, total.tree / ticks, total.populate / ticks, total.long_range / ticks,
+                total.force / ticks, total.move / ticks, total.grid / ticks, sum / ticks,
+                boids ? sum / ticks * 1e6 / boids : 0.0);
+}
+
+int main(int argc, char * argv[])
+{
+    HeadlessOptions options;
+    if (!ParseOptions(argc, argv, options) || options.ticks == 0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    PE::SetRandomSeed(options.seed);
+    PE::ThreadPool::GetInstance().SetNumThreads(options.threads);
+
+    BoidSim prey, predators;
+    SetupGroup(prey, options, 1000000, options.boids);
+    SetupGroup(predators, options, -1000000, options.predators);
+    prey.AddFearedBoids(&predators);
+    predators.AddFearedBoids(&prey);
+
+    std::printf("%u boids, %u predators, %u ticks at %.0f Hz, %u threads, %s kernels, %s grid, seed %llu\n",
+                options.boids, options.predators, options.ticks, options.tick_rate,
+                PE::ThreadPool::GetInstance().GetNumThreads(), GetBoidKernels().name,
+                options.unbounded ? "unbounded" : "bounded", static_cast<unsigned long long>(options.seed));
+
+    float dt = 1.f / options.tick_rate;
+    SimPhaseTimes prey_total, predator_total;
+    BudgetTotals prey_budgets, predator_budgets;
+    ListTotals prey_lists, predator_lists;
+    LodTotals prey_lod, predator_lod;
+    PE::RandomStream churn_stream(options.seed, CHURN_STREAM);
+    std::vector<BoidHandle> churned;
+    double churn_ms = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint tick = 0; tick < options.ticks; ++tick)
+    {
+        // Replace random prey with new ones, as if they died and others were born.
+        if (options.churn && prey.GetNumBoids())
+        {
+            auto churn_start = std::chrono::steady_clock::now();
+            churned.clear();
+            for (uint i = 0; i < options.churn; ++i)
+                churned.emplace_back(prey.GetHandle(churn_stream.NextUint() % prey.GetNumBoids()));
+            prey.RemoveBoids(churned);
+            prey.AddBoids(options.churn);
+            churn_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                                  churn_start).count();
+        }
+
+        // Budgets the tick runs with, as the scheduler may change them after every tick.
+        AddBudgets(prey_budgets, prey);
+        AddBudgets(predator_budgets, predators);
+        prey.Update(dt);
+        AddTimes(prey_total, prey.GetPhaseTimes());
+        AddLists(prey_lists, prey);
+        AddLod(prey_lod, prey);
+        predators.Update(dt);
+        AddTimes(predator_total, predators.GetPhaseTimes());
+        AddLists(predator_lists, predators);
+        AddLod(predator_lod, predators);
+    }
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("\n%-10s %10s %10s %10s %10s %10s %10s %10s %10s %12s\n", "ms/tick", "reorder", "tree",
+                "populate", "long range", "force", "move", "grid", "total", "ns/boid");
+    PrintTimes("prey", prey_total, options.ticks, prey.GetNumBoids());
+    PrintTimes("predators", predator_total, options.ticks, predators.GetNumBoids());
+    bool verlet = options.verlet_skin > 0;
+    if (verlet)
+        std::printf("\n%-10s %10s %10s %10s %10s\n", "lists", "gathered", "mean age", "max age", "max drift");
+    else
+        std::printf("\n%-10s %10s\n", "lists", "gathered");
+    PrintLists("prey", prey_lists, options.ticks, verlet);
+    PrintLists("predators", predator_lists, options.ticks, verlet);
+    if (options.lod_distance > 0)
+    {
+        std::printf("\n%-10s %10s %12s\n", "lod", "updated", "out of sight");
+        PrintLod("prey", prey_lod, options.ticks);
+        PrintLod("predators", predator_lod, options.ticks);
+    }
+    if (options.target_ms > 0)
+    {
+        std::printf("\n%-10s %10s %10s %10s\n", "boids/tick", "populate", "force", "grid");
+        PrintBudgets("prey", prey_budgets, options.ticks);
+        PrintBudgets("predators", predator_budgets, options.ticks);
+    }
+    if (options.churn)
+        std::printf("\nchurn      %10.3f ms/tick to replace %u boids\n", churn_ms / options.ticks, options.churn);
+    std::printf("\n%.3f ms per tick wall, %.1f ticks/s\n", wall_ms / options.ticks,
+                options.ticks * 1000.0 / wall_ms);
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cmath>
+#include "BudgetScheduler.h"
+
+// Share of the boids each per-tick budget covers when a group is first spawned.
+static const uint UPDATE_DIVISOR = 2;
+static const uint GRID_UPDATE_DIVISOR = 32;
+static const uint POPULATE_DIVISOR = 120;
+
+// Weight of the latest tick in the running costs. Low enough that a single
+// hitch doesn't throw the budgets around, high enough to follow a load change in a second or so.
+static const double COST_SMOOTHING = 0.1;
+
+// Halvings when searching for the budget scale. Far finer than one boid.
+static const uint SCALE_SEARCH_STEPS = 32;
+
+SimBudgets BudgetScheduler::DefaultBudgets(uint num_boids)
+{
+    return SimBudgets{num_boids / UPDATE_DIVISOR, num_boids / GRID_UPDATE_DIVISOR, num_boids / POPULATE_DIVISOR};
+}
+
+SimBudgets BudgetScheduler::Plan(const SimPhaseTimes & times, const SimBudgets & ran, uint num_boids, float dt)
+{
+    if (num_boids == 0)
+        return ran;
+
+    // Fold this tick into the running costs. The first tick is taken as it is.
+    auto learn = [&](double & cost, double ms, uint boids)
+    {
+        if (boids == 0)
+            return;
+        double sample = ms / boids;
+        cost = measured ? cost + (sample - cost) * COST_SMOOTHING : sample;
+    };
+    learn(update_cost, times.force, ran.updates);
+    learn(grid_cost, times.grid, ran.grid_updates);
+    learn(populate_cost, times.populate, ran.populates);
+    learn(fixed_cost, times.reorder + times.tree + times.long_range + times.move, num_boids);
+    measured = true;
+
+    // Each phase has to reach every boid at least once per MaxStaleness seconds.
+    uint floor = num_boids;
+    if (MaxStaleness > 0)
+        floor = static_cast<uint>(std::ceil(num_boids * dt / MaxStaleness));
+    floor = std::clamp(floor, 1u, num_boids);
+
+    SimBudgets shares = DefaultBudgets(num_boids);
+    auto at_scale = [&](double scale)
+    {
+        auto budget = [&](uint share)
+        {
+            double scaled = std::max(share, 1u) * scale;
+            return scaled >= num_boids ? num_boids : std::max(floor, static_cast<uint>(scaled));
+        };
+        return SimBudgets{budget(shares.updates), budget(shares.grid_updates), budget(shares.populates)};
+    };
+    auto predict = [&](const SimBudgets & budgets)
+    {
+        return fixed_cost * num_boids + update_cost * budgets.updates + grid_cost * budgets.grid_updates +
+               populate_cost * budgets.populates;
+    };
+
+    // Past this scale every budget covers all the boids.
+    double low = 0, high = num_boids;
+    if (predict(at_scale(high)) <= TargetMs)
+        return at_scale(high);
+    if (predict(at_scale(low)) >= TargetMs)
+        return at_scale(low);
+
+    // The predicted time only grows with the scale, so home in on the largest one that fits.
+    for (uint step = 0; step < SCALE_SEARCH_STEPS; ++step)
+    {
+        double middle = (low + high) / 2;
+        if (predict(at_scale(middle)) <= TargetMs)
+            low = middle;
+        else
+            high = middle;
+    }
+    return at_scale(low);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Engine/Types.h"
+
+// Wall time in milliseconds each phase of the latest tick took.
+struct SimPhaseTimes
+{
+    double reorder = 0;
+    // Rebuilding the nearest neighbor tree, 0 outside nearest neighbor mode.
+    double tree = 0;
+    double populate = 0;
+    // Rebuilding the octree and gathering long range sums, 0 while the long range distance is.
+    double long_range = 0;
+    double force = 0;
+    double move = 0;
+    double grid = 0;
+};
+
+// How many boids each staggered phase reaches in a tick.
+struct SimBudgets
+{
+    uint updates = 0;
+    uint grid_updates = 0;
+    uint populates = 0;
+};
+
+/*!
+@brief Picks the budgets of the staggered phases so each tick takes about a
+   target time. It keeps a running cost per boid of every phase from the
+   measured times, then scales all three budgets by one factor, keeping the
+   default proportions between them, until the predicted tick fits. No
+   budget drops below what reaches every boid within the staleness bound,
+   even if the tick runs over because of it.
+*/
+class BudgetScheduler
+{
+public:
+    // Budgets a newly spawned group of num_boids starts with.
+    [[nodiscard]] static SimBudgets DefaultBudgets(uint num_boids);
+
+    // Wall time in milliseconds a tick should take. 0 leaves the budgets as they are set.
+    float TargetMs = 0;
+
+    // Longest a boid may go between refreshes by each phase, in seconds.
+    float MaxStaleness = 2;
+
+    [[nodiscard]] bool Enabled() const
+    { return TargetMs > 0; }
+
+    // Learns from the times of a tick that ran with budgets ran, and returns the budgets for the next one.
+    SimBudgets Plan(const SimPhaseTimes & times, const SimBudgets & ran, uint num_boids, float dt);
+
+private:
+    // Milliseconds per boid of each staggered phase, and of the phases every boid runs each tick.
+    double update_cost = 0;
+    double grid_cost = 0;
+    double populate_cost = 0;
+    double fixed_cost = 0;
+    bool measured = false;
+};
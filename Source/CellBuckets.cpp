@@ -0,0 +1,125 @@
+#include <algorithm>
+#include "CellBuckets.h"
+
+// A spilled cell moves back inline once it drops to this many boids. Lower than
+// INLINE_SIZE so a cell hovering around the limit doesn't copy on every move.
+static const uint UNSPILL_SIZE = CellBuckets::INLINE_SIZE / 2;
+
+uint CellBuckets::AddCell()
+{
+    if (free_cells.empty())
+    {
+        cells.emplace_back(Cell{0, NO_CELL, {}});
+        return static_cast<uint>(cells.size() - 1);
+    }
+
+    uint cell = free_cells.back();
+    free_cells.pop_back();
+    return cell;
+}
+
+void CellBuckets::FreeCell(uint cell)
+{
+    free_cells.emplace_back(cell);
+}
+
+void CellBuckets::Add(uint cell)
+{
+    uint boid = NumBoids();
+    locations.emplace_back();
+    all_boids.emplace_back(boid);
+    Push(cell, boid);
+}
+
+uint CellBuckets::Move(uint boid, uint cell)
+{
+    uint old_cell = locations[boid].cell;
+    Pop(boid);
+    Push(cell, boid);
+    return old_cell;
+}
+
+uint CellBuckets::SwapRemove(uint boid)
+{
+    uint old_cell = locations[boid].cell;
+    Pop(boid);
+
+    // The last boid keeps its place in its cell, only the index stored there changes.
+    uint last = NumBoids() - 1;
+    if (boid != last)
+    {
+        Location moved = locations[last];
+        Data(cells[moved.cell])[moved.slot] = boid;
+        locations[boid] = moved;
+    }
+    locations.pop_back();
+    all_boids.pop_back();
+    return old_cell;
+}
+
+void CellBuckets::Clear()
+{
+    cells.clear();
+    free_cells.clear();
+    locations.clear();
+    all_boids.clear();
+
+    // Keep the spill blocks and their capacity for the next build.
+    free_spills.clear();
+    for (uint spill = 0; spill < spills.size(); ++spill)
+    {
+        spills[spill].clear();
+        free_spills.emplace_back(spill);
+    }
+}
+
+void CellBuckets::Push(uint cell, uint boid)
+{
+    Cell & c = cells[cell];
+    if (c.count == INLINE_SIZE && c.spill == NO_CELL)
+    {
+        if (free_spills.empty())
+        {
+            c.spill = static_cast<uint>(spills.size());
+            spills.emplace_back();
+        }
+        else
+        {
+            c.spill = free_spills.back();
+            free_spills.pop_back();
+        }
+        spills[c.spill].assign(c.boids, c.boids + INLINE_SIZE);
+    }
+
+    if (c.spill == NO_CELL)
+        c.boids[c.count] = boid;
+    else
+        spills[c.spill].emplace_back(boid);
+    locations[boid] = Location{cell, c.count};
+    ++c.count;
+}
+
+void CellBuckets::Pop(uint boid)
+{
+    Location at = locations[boid];
+    Cell & c = cells[at.cell];
+    uint * data = Data(c);
+
+    // Fill the gap with the cell's last boid.
+    uint last = data[c.count - 1];
+    data[at.slot] = last;
+    locations[last].slot = at.slot;
+    --c.count;
+
+    if (c.spill != NO_CELL)
+    {
+        spills[c.spill].pop_back();
+        if (c.count <= UNSPILL_SIZE)
+        {
+            std::copy(spills[c.spill].begin(), spills[c.spill].end(), c.boids);
+            spills[c.spill].clear();
+            free_spills.emplace_back(c.spill);
+            c.spill = NO_CELL;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include "Engine/Types.h"
+#include "IndexSpan.h"
+
+// Cell id meaning no cell has been made for a key.
+const uint NO_CELL = ~0u;
+
+/*!
+@brief Boid indices filed into cells, the storage behind both spatial
+   indexes. Each cell keeps its first few boids in an inline array and only
+   spills into a heap block when crowded, and spilled blocks are recycled
+   rather than freed. Every boid remembers its cell and its slot there, so
+   moving or removing one swaps the last boid of its cell into the gap
+   instead of searching, and costs the same however crowded the cell is.
+*/
+class CellBuckets
+{
+public:
+    // Boids a cell holds before spilling out of line.
+    static const uint INLINE_SIZE = 6;
+
+    // Makes an empty cell, reusing a freed one if there is one, and returns its id.
+    uint AddCell();
+
+    // Returns an empty cell's id for reuse.
+    void FreeCell(uint cell);
+
+    // Files the next boid, NumBoids(), under cell.
+    void Add(uint cell);
+
+    // Moves boid into cell and returns the cell it left.
+    uint Move(uint boid, uint cell);
+
+    // Takes boid out and refiles the last boid under boid's index, matching a
+    // swap-and-pop of the boid arrays. Returns the cell boid left.
+    uint SwapRemove(uint boid);
+
+    void Clear();
+
+    [[nodiscard]] uint NumBoids() const
+    { return static_cast<uint>(locations.size()); }
+
+    [[nodiscard]] uint Count(uint cell) const
+    { return cells[cell].count; }
+
+    [[nodiscard]] IndexSpan Get(uint cell) const
+    {
+        const Cell & c = cells[cell];
+        const uint * first = c.spill == NO_CELL ? c.boids : spills[c.spill].data();
+        return IndexSpan{first, first + c.count};
+    }
+
+    // Every boid, in index order.
+    [[nodiscard]] IndexSpan GetAll() const
+    { return IndexSpan{all_boids.data(), all_boids.data() + all_boids.size()}; }
+
+private:
+    struct Cell
+    {
+        uint count;
+        // Index into spills once the cell has outgrown its inline array, otherwise NO_CELL.
+        uint spill;
+        uint boids[INLINE_SIZE];
+    };
+
+    struct Location
+    {
+        uint cell;
+        uint slot;
+    };
+
+    [[nodiscard]] uint * Data(Cell & cell)
+    { return cell.spill == NO_CELL ? cell.boids : spills[cell.spill].data(); }
+
+    void Push(uint cell, uint boid);
+    void Pop(uint boid);
+
+    std::vector<Cell> cells;
+    std::vector<uint> free_cells;
+
+    // Out of line storage for crowded cells, kept at capacity when a cell shrinks back.
+    std::vector<std::vector<uint>> spills;
+    std::vector<uint> free_spills;
+
+    std::vector<Location> locations;
+
+    // 0 to NumBoids() - 1, for handing out every boid as one run.
+    std::vector<uint> all_boids;
+};
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include "CellList.h"
+
+void CellList::SetBounds(float offset, float size, float cell_size)
+{
+    grid_offset = offset;
+    grid_size = size;
+    grid_cells = std::clamp(static_cast<uint>(size / cell_size), 1u, GRID_SIZE);
+}
+
+CellList::GridPos CellList::GetGridPosition(const PE::Vec3 & position) const
+{
+    // Boids outside the grid are filed under the nearest edge cell
+    // rather than dropped, so they still find their neighbors.
+    float cells_per_unit = (float) grid_cells / grid_size;
+    float max_cell = (float) (grid_cells - 1);
+    uint x = uint(std::clamp((position.x + grid_offset) * cells_per_unit, 0.f, max_cell));
+    uint y = uint(std::clamp((position.y + grid_offset) * cells_per_unit, 0.f, max_cell));
+    uint z = uint(std::clamp((position.z + grid_offset) * cells_per_unit, 0.f, max_cell));
+    return GridPos{x, y, z};
+}
+
+uint CellList::GetGridKey(const GridPos & position) const
+{
+    // X varies fastest, so a row of cells along x is one contiguous key range.
+    return position.x + grid_cells * (position.y + grid_cells * position.z);
+}
+
+CellKey CellList::GetKey(const PE::Vec3 & position) const
+{
+    return GetGridKey(GetGridPosition(position));
+}
+
+void CellList::Build(const CellKey * keys, uint count)
+{
+    Clear();
+    if (count == 0)
+        return;
+    
+    min_key = static_cast<uint>(*std::min_element(keys, keys + count));
+    uint max_key = static_cast<uint>(*std::max_element(keys, keys + count));
+    key_cells.assign(max_key - min_key + 1, NO_CELL);
+    
+    // Number the buckets in key order, so cells next to each other along x are
+    // next to each other in memory too, then file the boids in index order.
+    for (uint i = 0; i < count; ++i)
+        key_cells[keys[i] - min_key] = 0;
+    for (uint & cell : key_cells)
+        if (cell != NO_CELL)
+            cell = buckets.AddCell();
+    for (uint i = 0; i < count; ++i)
+        buckets.Add(key_cells[keys[i] - min_key]);
+}
+
+void CellList::Insert(const CellKey * keys, uint first, uint count)
+{
+    if (count == 0)
+        return;
+    if (key_cells.empty())
+    {
+        Build(keys, first + count);
+        return;
+    }
+    
+    // Widen the table once for the whole batch.
+    uint low = static_cast<uint>(*std::min_element(keys + first, keys + first + count));
+    uint high = static_cast<uint>(*std::max_element(keys + first, keys + first + count));
+    Widen(low, high);
+    for (uint i = first; i < first + count; ++i)
+        buckets.Add(FindOrAddCell(static_cast<uint>(keys[i])));
+}
+
+void CellList::Move(uint boid, CellKey from, CellKey to)
+{
+    uint left = buckets.Move(boid, FindOrAddCell(static_cast<uint>(to)));
+    ReleaseIfEmpty(static_cast<uint>(from), left);
+}
+
+void CellList::SwapRemove(uint boid, CellKey key)
+{
+    ReleaseIfEmpty(static_cast<uint>(key), buckets.SwapRemove(boid));
+}
+
+void CellList::Clear()
+{
+    min_key = 0;
+    key_cells.clear();
+    buckets.Clear();
+}
+
+void CellList::Widen(uint low, uint high)
+{
+    uint end = min_key + static_cast<uint>(key_cells.size());
+    if (key_cells.empty())
+    {
+        min_key = low;
+        key_cells.assign(high - low + 1, NO_CELL);
+        return;
+    }
+    
+    // Take in a layer of cells past the key too, so boids drifting over the edge
+    // of the occupied range don't widen it again on every move.
+    uint layer = grid_cells * grid_cells;
+    if (low < min_key)
+    {
+        uint new_min = low - std::min(low, layer);
+        key_cells.insert(key_cells.begin(), min_key - new_min, NO_CELL);
+        min_key = new_min;
+    }
+    if (high >= end)
+    {
+        uint num_keys = grid_cells * grid_cells * grid_cells;
+        key_cells.resize(std::min(high + layer + 1, num_keys) - min_key, NO_CELL);
+    }
+}
+
+uint CellList::FindOrAddCell(uint key)
+{
+    if (key < min_key || key - min_key >= key_cells.size())
+        Widen(key, key);
+    
+    uint & cell = key_cells[key - min_key];
+    if (cell == NO_CELL)
+        cell = buckets.AddCell();
+    return cell;
+}
+
+void CellList::ReleaseIfEmpty(uint key, uint cell)
+{
+    if (buckets.Count(cell) != 0)
+        return;
+    key_cells[key - min_key] = NO_CELL;
+    buckets.FreeCell(cell);
+}
+
+void CellList::GatherCells(const PE::Vec3 & position, uint reach, std::vector<IndexSpan> & cells) const
+{
+    GridPos center = GetGridPosition(position);
+    uint x_min = center.x - std::min(center.x, reach);
+    uint x_max = std::min(center.x + reach, grid_cells - 1);
+    
+    for (uint z = center.z - std::min(center.z, reach); z <= std::min(center.z + reach, grid_cells - 1); ++z)
+        for (uint y = center.y - std::min(center.y, reach); y <= std::min(center.y + reach, grid_cells - 1); ++y)
+        {
+            // X varies fastest, so a row of cells is a run of consecutive keys.
+            uint first = std::max(GetGridKey(GridPos{x_min, y, z}), min_key);
+            uint last = std::min(GetGridKey(GridPos{x_max, y, z}) + 1, min_key + (uint) key_cells.size());
+            for (uint key = first; key < last; ++key)
+            {
+                uint cell = key_cells[key - min_key];
+                if (cell != NO_CELL)
+                    cells.emplace_back(buckets.Get(cell));
+            }
+        }
+}
+
+float CellList::GetCellSize() const
+{
+    return grid_size / (float) grid_cells;
+}
+
+IndexSpan CellList::GetCell(uint key) const
+{
+    if (key < min_key || key - min_key >= key_cells.size() || key_cells[key - min_key] == NO_CELL)
+        return IndexSpan{nullptr, nullptr};
+    return buckets.Get(key_cells[key - min_key]);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include "Engine/Types.h"
+#include "SpatialIndex.h"
+#include "CellBuckets.h"
+
+// Maximum number of grid cells along each axis.
+const uint GRID_SIZE = 256;
+
+/*!
+@brief Compact spatial index over a bounded cube. A table indexed by cell
+   key gives each occupied cell's bucket of boids, and a boid changing cells
+   moves between buckets in constant time. The table only covers the range
+   between the lowest and highest occupied key, so memory scales with the
+   boids rather than with the volume of the grid.
+*/
+class CellList : public SpatialIndex
+{
+    struct GridPos
+    {
+        uint x, y, z;
+    };
+    
+public:
+    // Lay out the grid as a cube of size units starting at -offset on each
+    // axis, with cells no smaller than cell_size.
+    void SetBounds(float offset, float size, float cell_size);
+    
+    [[nodiscard]] CellKey GetKey(const PE::Vec3 & position) const override;
+    
+    // Rebuild from one cell key per boid in a single linear pass.
+    void Build(const CellKey * keys, uint count) override;
+    void Insert(const CellKey * keys, uint first, uint count) override;
+    void Move(uint boid, CellKey from, CellKey to) override;
+    void SwapRemove(uint boid, CellKey key) override;
+    void Clear() override;
+    
+    void GatherCells(const PE::Vec3 & position, uint reach, std::vector<IndexSpan> & cells) const override;
+    
+    [[nodiscard]] IndexSpan GetAll() const override
+    { return buckets.GetAll(); }
+    
+    [[nodiscard]] float GetCellSize() const override;
+    
+    // All boids in the cell with this key.
+    [[nodiscard]] IndexSpan GetCell(uint key) const;
+    
+private:
+    [[nodiscard]] GridPos GetGridPosition(const PE::Vec3 & position) const;
+    [[nodiscard]] uint GetGridKey(const GridPos & position) const;
+    
+    // Widens the key table to cover keys low through high.
+    void Widen(uint low, uint high);
+    
+    // Bucket of the cell with this key, widening the table and adding the bucket if needed.
+    uint FindOrAddCell(uint key);
+    
+    // Drops the key's bucket if the last boid just left it.
+    void ReleaseIfEmpty(uint key, uint cell);
+    
+    float grid_offset = 12;
+    float grid_size = 24;
+    uint grid_cells = 24;
+    
+    // Bucket of each key from min_key on, or NO_CELL for empty cells.
+    uint min_key = 0;
+    std::vector<uint> key_cells;
+    
+    CellBuckets buckets;
+};
@@ -2,54 +2,66 @@
 // Created by bryan on 2/23/20.
 //
 
-#include <chrono>
+#include <atomic>
 
 #include "Dice.h"
 
-RNG Die::generator(static_cast<unsigned long>(std::chrono::system_clock::now().time_since_epoch().count()));
-RNG DieReal::generator(static_cast<unsigned long>(std::chrono::system_clock::now().time_since_epoch().count()));
+std::uint64_t NextDieStream()
+{
+    static std::atomic<std::uint64_t> next_stream{0};
+    return (std::uint64_t{1} << 63) | next_stream++;
+}
 
 Die::Die(unsigned high) : Die(1, static_cast<int>(high))
 {}
 
-Die::Die(int low, int high) : roller(low, high), Low(low), High(high)
+Die::Die(int low, int high) : Low(low), High(high), stream(PE::GetRandomSeed(), NextDieStream())
 {}
 
-void Die::SetSeed(unsigned seed)
+void Die::SetSeed(std::uint64_t seed)
 {
-    generator = RNG(seed);
+    PE::SetRandomSeed(seed);
 }
 
 int Die::Roll()
 {
-    return roller(generator);
+    // Scale a 32-bit value onto the range rather than taking a remainder, which favors low results.
+    std::uint64_t range = static_cast<std::uint64_t>(static_cast<std::int64_t>(High) - Low + 1);
+    return Low + static_cast<int>((stream.NextUint() * range) >> 32);
 }
 
 int Die::Roll(int times)
 {
-    return roller(generator);
+    int total = 0;
+    for (int i = 0; i < times; ++i)
+        total += Roll();
+    return total;
 }
 
-DieReal::DieReal(float low, float high) : roller(low, high), Low(low), High(high)
+DieReal::DieReal(float low, float high) : Low(low), High(high), stream(PE::GetRandomSeed(), NextDieStream())
 {}
 
-void DieReal::SetSeed(unsigned seed)
+void DieReal::SetSeed(std::uint64_t seed)
 {
-    generator = RNG(seed);
+    PE::SetRandomSeed(seed);
 }
 
 float DieReal::Roll()
 {
-    return roller(generator);
+    return stream.NextFloat(Low, High);
 }
 
 float DieReal::Roll(int times)
 {
-    return roller(generator);
+    float total = 0;
+    for (int i = 0; i < times; ++i)
+        total += Roll();
+    return total;
 }
 
 float DieReal::Roll(float low, float high)
 {
-    auto die = std::uniform_real_distribution<float>(low, high);
-    return die(generator);
+    // Each thread rolls from its own stream.
+    thread_local PE::RandomStream shared_stream(PE::GetRandomSeed(), NextDieStream());
+    return shared_stream.NextFloat(low, high);
 }
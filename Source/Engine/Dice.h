@@ -4,9 +4,8 @@
 
 #pragma once
 
-#include <random>
-
-using RNG = std::mt19937_64;
+#include <cstdint>
+#include "Random.h"
 
 class Die
 {
@@ -25,10 +24,10 @@ public:
     Die(int low, int high);
 
     /**
-     * Sets the seed used by all dice.
+     * Sets the seed used by all dice created afterwards. Same as PE::SetRandomSeed.
      * @param seed
      */
-    static void SetSeed(unsigned seed);
+    static void SetSeed(std::uint64_t seed);
 
     /**
      * Roll the die once.
@@ -45,8 +44,7 @@ public:
 
     const int Low, High;
 private:
-    static RNG generator;
-    std::uniform_int_distribution<int> roller;
+    PE::RandomStream stream;
 };
 
 class DieReal
@@ -60,10 +58,10 @@ public:
     DieReal(float low, float high);
 
     /**
-     * Sets the seed used by all dice.
+     * Sets the seed used by all dice created afterwards. Same as PE::SetRandomSeed.
      * @param seed
      */
-    static void SetSeed(unsigned seed);
+    static void SetSeed(std::uint64_t seed);
 
     /**
      * Roll the die once.
@@ -82,6 +80,9 @@ public:
 
     const float Low, High;
 private:
-    static RNG generator;
-    std::uniform_real_distribution<float> roller;
+    PE::RandomStream stream;
 };
+
+// Stream number for the next die created. Dice streams live in the upper
+// half of the stream space, away from the ones boids are spawned from.
+std::uint64_t NextDieStream();
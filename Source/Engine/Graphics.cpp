@@ -19,6 +19,8 @@
 #include "Color.h"
 #include "FBO.h"
 #include "UI.h"
+#include "Profiler.h"
+#include "Trace.h"
 #include "imgui_impl_opengl3.h"
 
 #ifndef NDEBUG
@@ -119,6 +121,12 @@ namespace PE
       
       instance = this;
       
+      Profiler & profiler = Profiler::GetInstance();
+      gbuffer_counter = profiler.Register("G-buffer pass");
+      lighting_counter = profiler.Register("Lighting pass");
+      imgui_counter = profiler.Register("ImGui");
+      swap_counter = profiler.Register("Swap");
+      
       // Create FSQ mesh.
       std::vector<Vertex> vertices;
       std::vector<uint> indices;
@@ -155,6 +163,8 @@ namespace PE
     // Update the window and check for events.
     void Graphics::Update(float dt)
     {
+      TraceZone zone("Graphics::Update");
+      
       RecalcWTNDC();
       
       PreDraw();
@@ -166,9 +176,17 @@ namespace PE
       LogError(__FILE__, __LINE__);
       RenderObjects(0);
       
-      UpdateImgui(window);
+      {
+        ScopedTimer timer(imgui_counter);
+        TraceZone imgui_zone("ImGui");
+        UpdateImgui(window);
+      }
       
-      PostDraw();
+      {
+        ScopedTimer timer(swap_counter);
+        TraceZone swap_zone("SDL_GL_SwapWindow");
+        PostDraw();
+      }
       
       // Ensure no errors.
       LogError(__FILE__, __LINE__);
@@ -279,6 +297,7 @@ namespace PE
       shader.uSpecular = glGetUniformLocation(shader.program, "specular");
       shader.uShininess = glGetUniformLocation(shader.program, "shininess");
       shader.uMode = glGetUniformLocation(shader.program, "mode");
+      shader.uInstanceScale = glGetUniformLocation(shader.program, "instance_scale");
       
       // Ensure no errors.
       LogError(__FILE__, __LINE__);
@@ -346,6 +365,9 @@ namespace PE
     // Draw scene to given framebuffer.
     void Graphics::RenderObjects(GLuint target_framebuffer)
     {
+      Profiler & profiler = Profiler::GetInstance();
+      std::chrono::steady_clock::time_point phase_start = std::chrono::steady_clock::now();
+      
       gBuffer->Bind();
       
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -365,6 +387,8 @@ namespace PE
       // Unset FBO render target
       gBuffer->Unbind();
       LogError(__FILE__, __LINE__);
+      Tracer::GetInstance().Record("G-buffer pass", phase_start);
+      profiler.Lap(gbuffer_counter, phase_start);
       
       // Set the viewport, and clear the screen
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -430,6 +454,9 @@ namespace PE
       
       for (auto r : debug_objects)
         r->DrawDebug(current_shader, projection_view, &WHITE);
+      
+      Tracer::GetInstance().Record("Lighting pass", phase_start);
+      profiler.Lap(lighting_counter, phase_start);
     }
     
     // Transfer the finished screen frame to the game window.
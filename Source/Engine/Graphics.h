@@ -36,6 +36,7 @@ namespace PE
         GLuint uSpecular = 0;
         GLuint uShininess = 0;
         GLuint uMode = 0;
+        GLuint uInstanceScale = 0;
     };
 
     class Graphics
@@ -122,5 +123,11 @@ namespace PE
         PrerenderFBO * gBuffer;
 
         Mesh * FSQ{};
+
+        // Profiler counters for each part of a frame. CPU time only, the GPU runs behind.
+        uint gbuffer_counter = 0;
+        uint lighting_counter = 0;
+        uint imgui_counter = 0;
+        uint swap_counter = 0;
     };
 }
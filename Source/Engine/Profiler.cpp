@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include "Profiler.h"
+
+namespace PE
+{
+    Profiler & Profiler::GetInstance()
+    {
+        static Profiler instance;
+        return instance;
+    }
+
+    uint Profiler::Register(const std::string & name, CounterKind kind)
+    {
+        for (uint i = 0; i < counters.size(); ++i)
+            if (counters[i].name == name)
+                return i;
+
+        // Frames before the counter existed read as zero.
+        Counter counter;
+        counter.name = name;
+        counter.kind = kind;
+        counter.history.resize(HISTORY_SIZE, 0.f);
+        counters.emplace_back(std::move(counter));
+        return static_cast<uint>(counters.size() - 1);
+    }
+
+    void Profiler::Add(uint counter, double value)
+    {
+        counters[counter].current += value;
+    }
+
+    void Profiler::Lap(uint counter, std::chrono::steady_clock::time_point & start)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        Add(counter, std::chrono::duration<double, std::milli>(now - start).count());
+        start = now;
+    }
+
+    void Profiler::EndFrame(double frame_ms)
+    {
+        if (frame_times.empty())
+            frame_times.resize(HISTORY_SIZE, 0.f);
+
+        frame_times[next_frame] = static_cast<float>(frame_ms);
+        for (Counter & counter : counters)
+        {
+            counter.history[next_frame] = static_cast<float>(counter.current);
+            counter.current = 0;
+        }
+
+        next_frame = (next_frame + 1) % HISTORY_SIZE;
+        num_frames = std::min(num_frames + 1, HISTORY_SIZE);
+    }
+
+    uint Profiler::GetNumCounters() const
+    {
+        return static_cast<uint>(counters.size());
+    }
+
+    const std::string & Profiler::GetName(uint counter) const
+    {
+        return counters[counter].name;
+    }
+
+    CounterKind Profiler::GetKind(uint counter) const
+    {
+        return counters[counter].kind;
+    }
+
+    uint Profiler::GetNumFrames() const
+    {
+        return num_frames;
+    }
+
+    void Profiler::Unroll(const std::vector<float> & ring, std::vector<float> & out) const
+    {
+        out.clear();
+        if (ring.empty())
+            return;
+
+        uint first = (next_frame + HISTORY_SIZE - num_frames) % HISTORY_SIZE;
+        for (uint i = 0; i < num_frames; ++i)
+            out.emplace_back(ring[(first + i) % HISTORY_SIZE]);
+    }
+
+    void Profiler::GetHistory(uint counter, std::vector<float> & out) const
+    {
+        Unroll(counters[counter].history, out);
+    }
+
+    void Profiler::GetFrameTimes(std::vector<float> & out) const
+    {
+        Unroll(frame_times, out);
+    }
+
+    float Profiler::GetAverage(uint counter) const
+    {
+        if (num_frames == 0)
+            return 0;
+
+        std::vector<float> history;
+        GetHistory(counter, history);
+        double sum = 0;
+        for (float value : history)
+            sum += value;
+        return static_cast<float>(sum / num_frames);
+    }
+
+    FrameTimeStats Profiler::GetFrameStats() const
+    {
+        FrameTimeStats stats;
+        if (num_frames == 0)
+            return stats;
+
+        std::vector<float> sorted;
+        GetFrameTimes(sorted);
+        std::sort(sorted.begin(), sorted.end());
+
+        double sum = 0;
+        for (float frame_ms : sorted)
+            sum += frame_ms;
+
+        // Nearest rank percentiles.
+        auto percentile = [&](float p)
+        {
+            uint rank = static_cast<uint>(std::ceil(p / 100.f * sorted.size()));
+            return sorted[std::clamp(rank, 1u, num_frames) - 1];
+        };
+
+        stats.mean = static_cast<float>(sum / num_frames);
+        stats.p50 = percentile(50);
+        stats.p95 = percentile(95);
+        stats.p99 = percentile(99);
+        stats.max = sorted.back();
+        return stats;
+    }
+
+    bool Profiler::WriteCsv(const std::string & path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+            return false;
+
+        file << "frame,frame_ms";
+        for (const Counter & counter : counters)
+            file << ',' << counter.name << (counter.kind == CounterKind::Time ? " (ms)" : "");
+        file << '\n';
+
+        std::vector<float> frames;
+        GetFrameTimes(frames);
+        std::vector<std::vector<float>> histories(counters.size());
+        for (uint i = 0; i < counters.size(); ++i)
+            GetHistory(i, histories[i]);
+
+        for (uint frame = 0; frame < frames.size(); ++frame)
+        {
+            file << frame << ',' << frames[frame];
+            for (const auto & history : histories)
+                file << ',' << history[frame];
+            file << '\n';
+        }
+        return static_cast<bool>(file);
+    }
+
+    ScopedTimer::ScopedTimer(uint counter) : counter(counter), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ScopedTimer::~ScopedTimer()
+    {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        Profiler::GetInstance().Add(counter, elapsed.count());
+    }
+}
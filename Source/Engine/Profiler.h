@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include "Types.h"
+
+namespace PE
+{
+    // What a counter's per-frame total measures.
+    enum class CounterKind
+    {
+        // Milliseconds.
+        Time,
+        // Number of things done.
+        Count
+    };
+
+    // Frame time summary over the recorded history, in milliseconds.
+    struct FrameTimeStats
+    {
+        float mean = 0;
+        float p50 = 0;
+        float p95 = 0;
+        float p99 = 0;
+        float max = 0;
+    };
+
+    /*!
+    @brief Always-on registry of named per-frame counters. Values added during
+       a frame are summed, and EndFrame pushes each total into a fixed-size
+       history alongside the frame time. Only the main thread records.
+    */
+    class Profiler
+    {
+    public:
+        // Frames of history kept for every counter.
+        static const uint HISTORY_SIZE = 600;
+
+        // Gets the profiler shared by the whole program.
+        static Profiler & GetInstance();
+
+        /*!
+        @brief Returns the id of the counter with this name, adding it the first
+           time it's asked for. Look ids up once and keep them, so recording
+           doesn't pay for a name search.
+        */
+        uint Register(const std::string & name, CounterKind kind = CounterKind::Time);
+
+        // Adds value to the counter's total for the current frame.
+        void Add(uint counter, double value);
+
+        // Adds the milliseconds since start to the counter, then restarts start for the next phase.
+        void Lap(uint counter, std::chrono::steady_clock::time_point & start);
+
+        // Closes the current frame, recording how long it took and every counter's total.
+        void EndFrame(double frame_ms);
+
+        [[nodiscard]] uint GetNumCounters() const;
+        [[nodiscard]] const std::string & GetName(uint counter) const;
+        [[nodiscard]] CounterKind GetKind(uint counter) const;
+
+        // Number of frames currently in the history.
+        [[nodiscard]] uint GetNumFrames() const;
+
+        // Copies the history into out, oldest frame first.
+        void GetHistory(uint counter, std::vector<float> & out) const;
+        void GetFrameTimes(std::vector<float> & out) const;
+
+        [[nodiscard]] float GetAverage(uint counter) const;
+        [[nodiscard]] FrameTimeStats GetFrameStats() const;
+
+        // Writes one row per recorded frame, with a column per counter. Returns false if the file can't be written.
+        bool WriteCsv(const std::string & path) const;
+
+    private:
+        struct Counter
+        {
+            std::string name;
+            CounterKind kind = CounterKind::Time;
+            double current = 0;
+            std::vector<float> history;
+        };
+
+        // Copies a ring buffer into out, oldest first.
+        void Unroll(const std::vector<float> & ring, std::vector<float> & out) const;
+
+        std::vector<Counter> counters;
+        std::vector<float> frame_times;
+
+        // Ring buffer slot the next frame is written to.
+        uint next_frame = 0;
+        uint num_frames = 0;
+    };
+
+    // Adds the time between its construction and destruction to a counter.
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(uint counter);
+        ~ScopedTimer();
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer & operator=(const ScopedTimer &) = delete;
+
+    private:
+        uint counter;
+        std::chrono::steady_clock::time_point start;
+    };
+}
@@ -6,6 +6,9 @@
 
 #define SDL_MAIN_HANDLED
 #include "Graphics.h"
+#include "SimClock.h"
+#include "Profiler.h"
+#include "Trace.h"
 #include "../GameLoop.h"
 
 const int FPS_TARGET = 60;
@@ -26,6 +29,10 @@ int main(int args, char * argv[])
     std::chrono::steady_clock::time_point prev_time = std::chrono::steady_clock::now();
     std::chrono::steady_clock::time_point cur_time;
     float dt = 0;
+    PE::SimClock & sim_clock = PE::SimClock::GetInstance();
+    PE::Profiler & profiler = PE::Profiler::GetInstance();
+    PE::Tracer & tracer = PE::Tracer::GetInstance();
+    tracer.SetThreadName("Main");
 
     GameInit(cmd_args);
 
@@ -39,12 +46,25 @@ int main(int args, char * argv[])
             std::this_thread::sleep_for(std::chrono::milliseconds(FRAME_MS - ms_elapsed));
             continue;
         }
+        double frame_ms = std::chrono::duration<double, std::milli>(cur_time - prev_time).count();
         prev_time = cur_time;
         dt = ms_elapsed / 1000.0f;
 
-        running = GameLoop(dt);
+        tracer.BeginFrame();
+        {
+            PE::TraceZone zone("Frame");
+
+            // Step the simulation in fixed ticks, however long the frame took.
+            uint ticks = sim_clock.Advance(dt);
+            for (uint i = 0; i < ticks; ++i)
+                GameTick(sim_clock.GetTickLength());
+
+            running = GameLoop(dt);
+
+            graphics.Update(dt);
+        }
 
-        graphics.Update(dt);
+        profiler.EndFrame(frame_ms);
     }
 
     GameShutdown();
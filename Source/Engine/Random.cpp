@@ -0,0 +1,153 @@
+#include <atomic>
+#include <chrono>
+#include "Random.h"
+
+namespace PE
+{
+    // Philox4x32 round multipliers and key increments.
+    const std::uint32_t PHILOX_M0 = 0xD2511F53;
+    const std::uint32_t PHILOX_M1 = 0xCD9E8D57;
+    const std::uint32_t PHILOX_W0 = 0x9E3779B9;
+    const std::uint32_t PHILOX_W1 = 0xBB67AE85;
+    const uint PHILOX_ROUNDS = 10;
+
+    // Blocks generated side by side in Fill.
+    const uint FILL_BATCH = 8;
+
+    // 24 bits of mantissa mapped to [0, 1).
+    const float UINT_TO_FLOAT = 1.f / 16777216.f;
+
+    static std::atomic<std::uint64_t> random_seed{
+            static_cast<std::uint64_t>(std::chrono::system_clock::now().time_since_epoch().count())};
+
+    void SetRandomSeed(std::uint64_t seed)
+    {
+        random_seed = seed;
+    }
+
+    std::uint64_t GetRandomSeed()
+    {
+        return random_seed;
+    }
+
+    static inline float ToFloat(std::uint32_t value)
+    {
+        return static_cast<float>(value >> 8) * UINT_TO_FLOAT;
+    }
+
+    // One Philox4x32-10 block. The counter is {block low, block high, stream low, stream high}.
+    static inline void Philox(std::uint32_t c[4], std::uint32_t k0, std::uint32_t k1)
+    {
+        for (uint round = 0; round < PHILOX_ROUNDS; ++round)
+        {
+            std::uint64_t product0 = static_cast<std::uint64_t>(PHILOX_M0) * c[0];
+            std::uint64_t product1 = static_cast<std::uint64_t>(PHILOX_M1) * c[2];
+            std::uint32_t next0 = static_cast<std::uint32_t>(product1 >> 32) ^ c[1] ^ k0;
+            std::uint32_t next2 = static_cast<std::uint32_t>(product0 >> 32) ^ c[3] ^ k1;
+            c[0] = next0;
+            c[1] = static_cast<std::uint32_t>(product1);
+            c[2] = next2;
+            c[3] = static_cast<std::uint32_t>(product0);
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+    }
+
+    RandomStream::RandomStream(std::uint64_t seed, std::uint64_t stream)
+            : key{static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32)},
+              stream_words{static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32)}
+    {
+    }
+
+    void RandomStream::Seek(std::uint64_t index)
+    {
+        position = index;
+    }
+
+    void RandomStream::Refill()
+    {
+        block_index = position / 4;
+        block[0] = static_cast<std::uint32_t>(block_index);
+        block[1] = static_cast<std::uint32_t>(block_index >> 32);
+        block[2] = stream_words[0];
+        block[3] = stream_words[1];
+        Philox(block, key[0], key[1]);
+    }
+
+    std::uint32_t RandomStream::NextUint()
+    {
+        if (position / 4 != block_index)
+            Refill();
+        return block[position++ % 4];
+    }
+
+    float RandomStream::NextFloat()
+    {
+        return ToFloat(NextUint());
+    }
+
+    float RandomStream::NextFloat(float low, float high)
+    {
+        return low + NextFloat() * (high - low);
+    }
+
+    void RandomStream::Fill(float * out, std::size_t count, float low, float high)
+    {
+        float range = high - low;
+
+        // Finish a partly used block one value at a time.
+        while (count && position % 4)
+        {
+            *out++ = low + NextFloat() * range;
+            --count;
+        }
+
+        // Whole blocks, a batch at a time with each counter word in its own array,
+        // so every step of a round runs across the batch at once.
+        while (count >= FILL_BATCH * 4)
+        {
+            std::uint32_t c0[FILL_BATCH], c1[FILL_BATCH], c2[FILL_BATCH], c3[FILL_BATCH];
+            std::uint64_t first_block = position / 4;
+            for (uint lane = 0; lane < FILL_BATCH; ++lane)
+            {
+                c0[lane] = static_cast<std::uint32_t>(first_block + lane);
+                c1[lane] = static_cast<std::uint32_t>((first_block + lane) >> 32);
+                c2[lane] = stream_words[0];
+                c3[lane] = stream_words[1];
+            }
+
+            std::uint32_t k0 = key[0], k1 = key[1];
+            for (uint round = 0; round < PHILOX_ROUNDS; ++round)
+            {
+                for (uint lane = 0; lane < FILL_BATCH; ++lane)
+                {
+                    std::uint64_t product0 = static_cast<std::uint64_t>(PHILOX_M0) * c0[lane];
+                    std::uint64_t product1 = static_cast<std::uint64_t>(PHILOX_M1) * c2[lane];
+                    std::uint32_t next0 = static_cast<std::uint32_t>(product1 >> 32) ^ c1[lane] ^ k0;
+                    std::uint32_t next2 = static_cast<std::uint32_t>(product0 >> 32) ^ c3[lane] ^ k1;
+                    c0[lane] = next0;
+                    c1[lane] = static_cast<std::uint32_t>(product1);
+                    c2[lane] = next2;
+                    c3[lane] = static_cast<std::uint32_t>(product0);
+                }
+                k0 += PHILOX_W0;
+                k1 += PHILOX_W1;
+            }
+
+            for (uint lane = 0; lane < FILL_BATCH; ++lane)
+            {
+                out[lane * 4 + 0] = low + ToFloat(c0[lane]) * range;
+                out[lane * 4 + 1] = low + ToFloat(c1[lane]) * range;
+                out[lane * 4 + 2] = low + ToFloat(c2[lane]) * range;
+                out[lane * 4 + 3] = low + ToFloat(c3[lane]) * range;
+            }
+
+            out += FILL_BATCH * 4;
+            count -= FILL_BATCH * 4;
+            position += FILL_BATCH * 4;
+        }
+
+        while (count--)
+            *out++ = low + NextFloat() * range;
+    }
+}
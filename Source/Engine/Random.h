@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "Types.h"
+
+namespace PE
+{
+    // Sets the seed every random stream created afterwards starts from.
+    void SetRandomSeed(std::uint64_t seed);
+
+    // The current seed. Picked from the clock at startup unless set.
+    std::uint64_t GetRandomSeed();
+
+    /*!
+    @brief Counter-based random number stream (Philox4x32-10). Value i of a
+       stream is a pure function of the seed, the stream number and i, so any
+       number of threads can each take their own stream, or their own range
+       of one stream, and still get the same numbers on every run.
+    */
+    class RandomStream
+    {
+    public:
+        // Each stream number picks one of 2^64 independent sequences under the seed.
+        RandomStream(std::uint64_t seed, std::uint64_t stream);
+
+        // Moves to value index of the stream.
+        void Seek(std::uint64_t index);
+
+        std::uint32_t NextUint();
+
+        // Uniform in [0, 1).
+        float NextFloat();
+
+        // Uniform in [low, high).
+        float NextFloat(float low, float high);
+
+        /*!
+        @brief Fills out with the next count values of the stream, uniform in
+           [low, high). Generates whole blocks in batches laid out so the
+           compiler can vectorize them, which is much faster than NextFloat
+           for long runs.
+        */
+        void Fill(float * out, std::size_t count, float low, float high);
+
+    private:
+        void Refill();
+
+        std::uint32_t key[2];
+        std::uint32_t stream_words[2];
+
+        // Index of the next value, and the block it belongs to if already generated.
+        std::uint64_t position = 0;
+        std::uint32_t block[4]{};
+        std::uint64_t block_index = ~std::uint64_t{0};
+    };
+}
@@ -0,0 +1,49 @@
+#include <algorithm>
+#include "SimClock.h"
+
+namespace PE
+{
+    // Keep ticks a sane length even if asked for something absurd.
+    const float MIN_TICK_RATE = 1;
+    const float MAX_TICK_RATE = 1000;
+
+    SimClock & SimClock::GetInstance()
+    {
+        static SimClock instance;
+        return instance;
+    }
+
+    void SimClock::SetTickRate(float ticks_per_second)
+    {
+        tick_length = 1.f / std::clamp(ticks_per_second, MIN_TICK_RATE, MAX_TICK_RATE);
+        accumulator = std::min(accumulator, tick_length);
+    }
+
+    float SimClock::GetTickRate() const
+    {
+        return 1.f / tick_length;
+    }
+
+    float SimClock::GetTickLength() const
+    {
+        return tick_length;
+    }
+
+    uint SimClock::Advance(float dt)
+    {
+        accumulator += dt;
+        uint ticks = static_cast<uint>(accumulator / tick_length);
+        if (ticks > max_ticks_per_frame)
+        {
+            ticks = max_ticks_per_frame;
+            accumulator = tick_length * ticks;
+        }
+        accumulator -= tick_length * ticks;
+        return ticks;
+    }
+
+    float SimClock::GetAlpha() const
+    {
+        return std::clamp(accumulator / tick_length, 0.f, 1.f);
+    }
+}
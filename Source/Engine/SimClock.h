@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Types.h"
+
+namespace PE
+{
+    /*!
+    @brief Fixed timestep clock for the simulation. Real frame time is banked
+       in an accumulator and spent in whole ticks, so every step the simulation
+       takes is the same length no matter how fast frames are drawn.
+    */
+    class SimClock
+    {
+    public:
+        // Gets the clock shared by the whole program.
+        static SimClock & GetInstance();
+
+        void SetTickRate(float ticks_per_second);
+        [[nodiscard]] float GetTickRate() const;
+
+        // Length of one tick in seconds.
+        [[nodiscard]] float GetTickLength() const;
+
+        /*!
+        @brief Banks dt seconds of real time and returns how many ticks to run
+           for it. After a long stall, at most max_ticks_per_frame ticks are
+           returned and the rest of the backlog is dropped, so the simulation
+           slows down instead of falling further and further behind.
+        */
+        uint Advance(float dt);
+
+        // How far the current frame lies between the last two ticks, from 0 to 1.
+        [[nodiscard]] float GetAlpha() const;
+
+        uint max_ticks_per_frame = 8;
+
+    private:
+        float tick_length = 1.f / 60.f;
+        float accumulator = 0;
+    };
+}
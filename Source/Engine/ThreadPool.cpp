@@ -0,0 +1,140 @@
+#include <algorithm>
+#include "ThreadPool.h"
+#include "Trace.h"
+
+namespace PE
+{
+    ThreadPool::ThreadPool(uint num_threads)
+    {
+        SetNumThreads(num_threads);
+    }
+    
+    ThreadPool::~ThreadPool()
+    {
+        StopWorkers();
+    }
+    
+    ThreadPool & ThreadPool::GetInstance()
+    {
+        static ThreadPool instance;
+        return instance;
+    }
+    
+    void ThreadPool::SetNumThreads(uint num_threads)
+    {
+        if (num_threads == 0)
+            num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+        
+        if (num_threads == GetNumThreads())
+            return;
+        
+        StopWorkers();
+        StartWorkers(num_threads - 1);
+    }
+    
+    uint ThreadPool::GetNumThreads() const
+    {
+        return static_cast<uint>(workers.size()) + 1;
+    }
+    
+    void ThreadPool::StartWorkers(uint num_workers)
+    {
+        stopping = false;
+        
+        // Workers start from the current job generation, so a job posted before
+        // they first take the lock is still seen as new.
+        uint generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation = job_generation;
+        }
+        for (uint i = 0; i < num_workers; ++i)
+            workers.emplace_back(&ThreadPool::WorkerLoop, this, generation);
+    }
+    
+    void ThreadPool::StopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        job_ready.notify_all();
+        
+        for (auto & worker : workers)
+            worker.join();
+        workers.clear();
+    }
+    
+    void ThreadPool::WorkerLoop(uint seen_generation)
+    {
+        Tracer::GetInstance().SetThreadName("Worker");
+        
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                job_ready.wait(lock, [&]
+                { return stopping || job_generation != seen_generation; });
+                if (stopping)
+                    return;
+                seen_generation = job_generation;
+            }
+            
+            RunChunks();
+            
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy_workers == 0)
+                job_done.notify_one();
+        }
+    }
+    
+    void ThreadPool::RunChunks()
+    {
+        for (uint chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++)
+        {
+            TraceZone zone("ParallelFor chunk");
+            uint begin = chunk * job_chunk_size;
+            (*job)(begin, std::min(begin + job_chunk_size, job_count));
+        }
+    }
+    
+    void ThreadPool::ParallelFor(uint count, uint chunk_size, const ChunkFunction & function)
+    {
+        if (count == 0)
+            return;
+        
+        chunk_size = std::max(chunk_size, 1u);
+        uint chunks = (count + chunk_size - 1) / chunk_size;
+        
+        // Not worth waking anyone for a single chunk.
+        if (workers.empty() || chunks == 1)
+        {
+            for (uint begin = 0; begin < count; begin += chunk_size)
+            {
+                TraceZone zone("ParallelFor chunk");
+                function(begin, std::min(begin + chunk_size, count));
+            }
+            return;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &function;
+            job_count = count;
+            job_chunk_size = chunk_size;
+            num_chunks = chunks;
+            next_chunk = 0;
+            busy_workers = static_cast<uint>(workers.size());
+            ++job_generation;
+        }
+        job_ready.notify_all();
+        
+        // The calling thread works too instead of just waiting.
+        RunChunks();
+        
+        std::unique_lock<std::mutex> lock(mutex);
+        job_done.wait(lock, [&]
+        { return busy_workers == 0; });
+        job = nullptr;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Types.h"
+
+namespace PE
+{
+    /*!
+    @brief A fixed set of worker threads that stay alive for the whole run
+       and split loops between themselves and the calling thread.
+    */
+    class ThreadPool
+    {
+    public:
+        // Called with a half-open range [begin, end) of loop indices.
+        using ChunkFunction = std::function<void(uint begin, uint end)>;
+        
+        // Total thread count includes the calling thread. 0 means one per hardware thread.
+        explicit ThreadPool(uint num_threads = 0);
+        ~ThreadPool();
+        
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool & operator=(const ThreadPool &) = delete;
+        
+        // Gets the pool shared by the whole program.
+        static ThreadPool & GetInstance();
+        
+        void SetNumThreads(uint num_threads);
+        [[nodiscard]] uint GetNumThreads() const;
+        
+        /*!
+        @brief Splits [0, count) into chunks of chunk_size indices and runs
+           them across every thread, returning once all chunks are done.
+           Chunks may run in any order on any thread. Must not be called
+           from inside another ParallelFor.
+        */
+        void ParallelFor(uint count, uint chunk_size, const ChunkFunction & function);
+        
+    private:
+        void StartWorkers(uint num_workers);
+        void StopWorkers();
+        void WorkerLoop(uint seen_generation);
+        void RunChunks();
+        
+        std::vector<std::thread> workers;
+        
+        std::mutex mutex;
+        std::condition_variable job_ready;
+        std::condition_variable job_done;
+        bool stopping = false;
+        
+        // The job currently being run. Bumping job_generation wakes the workers.
+        const ChunkFunction * job = nullptr;
+        uint job_generation = 0;
+        uint job_count = 0;
+        uint job_chunk_size = 1;
+        uint num_chunks = 0;
+        std::atomic<uint> next_chunk{0};
+        uint busy_workers = 0;
+    };
+}
@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cstdio>
+#include "Trace.h"
+
+namespace PE
+{
+    Tracer & Tracer::GetInstance()
+    {
+        static Tracer instance;
+        return instance;
+    }
+
+    Tracer::Tracer() : epoch(Clock::now())
+    {
+    }
+
+    std::int64_t Tracer::ToNanoseconds(Clock::time_point time) const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time - epoch).count();
+    }
+
+    struct Tracer::ThreadSlot
+    {
+        ThreadBuffer * buffer = nullptr;
+        std::string name;
+
+        ~ThreadSlot()
+        {
+            if (buffer)
+                Tracer::GetInstance().ReleaseThreadBuffer(buffer);
+        }
+    };
+
+    Tracer::ThreadSlot & Tracer::GetThreadSlot()
+    {
+        thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    Tracer::ThreadBuffer & Tracer::GetThreadBuffer()
+    {
+        // Each thread takes its buffer once, after that recording takes no lock.
+        ThreadSlot & slot = GetThreadSlot();
+        if (slot.buffer)
+            return *slot.buffer;
+
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        auto reusable = std::find_if(free_buffers.begin(), free_buffers.end(), [](const ThreadBuffer * buffer)
+        { return buffer->written.load(std::memory_order_relaxed) == buffer->capture_start; });
+        if (reusable != free_buffers.end())
+        {
+            slot.buffer = *reusable;
+            free_buffers.erase(reusable);
+        }
+        else
+        {
+            buffers.emplace_back(std::make_unique<ThreadBuffer>());
+            slot.buffer = buffers.back().get();
+            slot.buffer->thread_id = static_cast<uint>(buffers.size() - 1);
+            slot.buffer->events.resize(BUFFER_SIZE);
+        }
+        slot.buffer->name = slot.name;
+        return *slot.buffer;
+    }
+
+    void Tracer::ReleaseThreadBuffer(ThreadBuffer * buffer)
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        free_buffers.emplace_back(buffer);
+    }
+
+    void Tracer::StartCapture()
+    {
+        if (IsCapturing())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(buffers_mutex);
+            for (auto & buffer : buffers)
+                buffer->capture_start = buffer->written.load(std::memory_order_acquire);
+        }
+        capturing.store(true, std::memory_order_relaxed);
+    }
+
+    bool Tracer::StopCapture(const std::string & path)
+    {
+        capturing.store(false, std::memory_order_relaxed);
+
+        std::FILE * file = std::fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+
+        std::fprintf(file, "{\"traceEvents\":[\n");
+        bool first = true;
+        std::uint64_t dropped = 0;
+
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        for (auto & buffer : buffers)
+        {
+            if (!buffer->name.empty())
+            {
+                std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                                   "\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", buffer->thread_id,
+                             buffer->name.c_str());
+                first = false;
+            }
+
+            // Only the newest BUFFER_SIZE zones of a long capture are still there.
+            std::uint64_t written = buffer->written.load(std::memory_order_acquire);
+            std::uint64_t start = std::max(buffer->capture_start, written > BUFFER_SIZE ? written - BUFFER_SIZE : 0);
+            dropped += start - std::min(start, buffer->capture_start);
+
+            for (std::uint64_t i = start; i < written; ++i)
+            {
+                const Event & event = buffer->events[i % BUFFER_SIZE];
+                std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                             first ? "" : ",\n", event.name, buffer->thread_id, event.begin_ns / 1000.0,
+                             (event.end_ns - event.begin_ns) / 1000.0);
+                first = false;
+            }
+        }
+
+        std::fprintf(file, "\n]}\n");
+        bool ok = std::ferror(file) == 0;
+        std::fclose(file);
+
+        if (dropped)
+            std::printf("Trace buffers wrapped, the oldest %llu zones were dropped.\n",
+                        static_cast<unsigned long long>(dropped));
+        return ok;
+    }
+
+    void Tracer::CaptureFrames(uint first, uint last, const std::string & path)
+    {
+        frames_scheduled = true;
+        first_frame = first;
+        last_frame = std::max(first, last);
+        frames_path = path;
+    }
+
+    void Tracer::BeginFrame()
+    {
+        if (frames_scheduled)
+        {
+            if (frame == first_frame)
+                StartCapture();
+            else if (frame == last_frame + 1)
+            {
+                frames_scheduled = false;
+                if (StopCapture(frames_path))
+                    std::printf("Wrote trace of frames %u to %u to %s\n", first_frame, last_frame,
+                                frames_path.c_str());
+                else
+                    std::printf("Couldn't write trace to %s\n", frames_path.c_str());
+            }
+        }
+        ++frame;
+    }
+
+    void Tracer::Record(const char * name, Clock::time_point begin)
+    {
+        if (!IsCapturing())
+            return;
+
+        Clock::time_point end = Clock::now();
+        ThreadBuffer & buffer = GetThreadBuffer();
+        std::uint64_t index = buffer.written.load(std::memory_order_relaxed);
+        buffer.events[index % BUFFER_SIZE] = Event{name, ToNanoseconds(begin), ToNanoseconds(end)};
+        buffer.written.store(index + 1, std::memory_order_release);
+    }
+
+    void Tracer::SetThreadName(const std::string & name)
+    {
+        ThreadSlot & slot = GetThreadSlot();
+        slot.name = name;
+        if (slot.buffer)
+        {
+            std::lock_guard<std::mutex> lock(buffers_mutex);
+            slot.buffer->name = name;
+        }
+    }
+
+    TraceZone::TraceZone(const char * name) : name(name), active(Tracer::GetInstance().IsCapturing())
+    {
+        if (active)
+            begin = Tracer::Clock::now();
+    }
+
+    TraceZone::~TraceZone()
+    {
+        if (active)
+            Tracer::GetInstance().Record(name, begin);
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Types.h"
+
+namespace PE
+{
+    /*!
+    @brief Records timed zones from any thread while a capture is running and
+       writes them out in Chrome's trace event format, for chrome://tracing or
+       Perfetto. Each thread writes into its own ring buffer without locking,
+       so when nothing is being captured a zone costs one atomic load.
+    */
+    class Tracer
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // Zones kept per thread. Older ones are overwritten if a capture runs longer.
+        static const uint BUFFER_SIZE = 1 << 16;
+
+        // Gets the tracer shared by the whole program.
+        static Tracer & GetInstance();
+
+        [[nodiscard]] bool IsCapturing() const
+        {
+            return capturing.load(std::memory_order_relaxed);
+        }
+
+        void StartCapture();
+
+        /*!
+        @brief Stops the capture and writes every zone recorded since it
+           started to path. Must be called while no other thread is recording,
+           i.e. between frames. Returns false if the file can't be written.
+        */
+        bool StopCapture(const std::string & path);
+
+        // Captures frames first through last, counted by BeginFrame, and writes them to path.
+        void CaptureFrames(uint first, uint last, const std::string & path);
+
+        // Marks the start of a main loop frame, starting or finishing a scheduled capture.
+        void BeginFrame();
+
+        // Records a zone from begin until now. name must outlive the capture, e.g. a string literal.
+        void Record(const char * name, Clock::time_point begin);
+
+        // Names the calling thread in the trace. Threads get a buffer only once they record a zone.
+        void SetThreadName(const std::string & name);
+
+    private:
+        struct Event
+        {
+            const char * name;
+            std::int64_t begin_ns;
+            std::int64_t end_ns;
+        };
+
+        // Written only by its own thread. Only the count is shared, published with release.
+        struct ThreadBuffer
+        {
+            uint thread_id = 0;
+            std::string name;
+            std::vector<Event> events;
+            std::atomic<std::uint64_t> written{0};
+
+            // Value of written when the current capture started.
+            std::uint64_t capture_start = 0;
+        };
+
+        // The calling thread's name and buffer. Hands the buffer back when the thread exits.
+        struct ThreadSlot;
+
+        Tracer();
+
+        static ThreadSlot & GetThreadSlot();
+
+        // Takes a buffer for the calling thread on its first zone.
+        ThreadBuffer & GetThreadBuffer();
+        void ReleaseThreadBuffer(ThreadBuffer * buffer);
+        [[nodiscard]] std::int64_t ToNanoseconds(Clock::time_point time) const;
+
+        std::atomic<bool> capturing{false};
+        Clock::time_point epoch;
+
+        // Buffers live until the program exits. Those of exited threads are
+        // reused once they hold nothing from the current capture.
+        std::mutex buffers_mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        std::vector<ThreadBuffer *> free_buffers;
+
+        uint frame = 0;
+        bool frames_scheduled = false;
+        uint first_frame = 0;
+        uint last_frame = 0;
+        std::string frames_path;
+    };
+
+    // Records the time between its construction and destruction as a zone.
+    class TraceZone
+    {
+    public:
+        explicit TraceZone(const char * name);
+        ~TraceZone();
+
+        TraceZone(const TraceZone &) = delete;
+        TraceZone & operator=(const TraceZone &) = delete;
+
+    private:
+        const char * name;
+        bool active;
+        Tracer::Clock::time_point begin;
+    };
+}
@@ -2,11 +2,17 @@
 
 #include <vector>
 #include <iostream>
+#include <cstdlib>
+#include <ctime>
 
 #include "Boids.h"
 #include "GameLoop.h"
-#include "Engine/Dice.h"
+#include "Engine/Random.h"
 #include "Engine/Graphics.h"
+#include "Engine/Profiler.h"
+#include "Engine/SimClock.h"
+#include "Engine/ThreadPool.h"
+#include "Engine/Trace.h"
 #include "Engine/imgui_impl_sdl.h"
 #include "GameUI.h"
 
@@ -26,8 +32,79 @@ PE::Model * bounding_sphere = nullptr;
 
 GameUI * game_ui = nullptr;
 
+// Profiler counters for the simulation, summed over every controller and tick in a frame.
+struct SimCounterIds
+{
+    uint reorder, tree, populate, long_range, force, move, grid;
+    uint render_data;
+    uint lists_gathered, cells_scanned, candidates_checked, neighbors_found;
+};
+SimCounterIds sim_counters;
+
+void RegisterSimCounters()
+{
+    PE::Profiler & profiler = PE::Profiler::GetInstance();
+    sim_counters.reorder = profiler.Register("Sim reorder");
+    sim_counters.tree = profiler.Register("Sim nearest tree");
+    sim_counters.populate = profiler.Register("Sim populate neighbors");
+    sim_counters.long_range = profiler.Register("Sim long range");
+    sim_counters.force = profiler.Register("Sim update force");
+    sim_counters.move = profiler.Register("Sim move");
+    sim_counters.grid = profiler.Register("Sim update grid");
+    sim_counters.render_data = profiler.Register("Render data");
+    sim_counters.lists_gathered = profiler.Register("Neighbor lists gathered", PE::CounterKind::Count);
+    sim_counters.cells_scanned = profiler.Register("Cells scanned", PE::CounterKind::Count);
+    sim_counters.candidates_checked = profiler.Register("Neighbor candidates checked", PE::CounterKind::Count);
+    sim_counters.neighbors_found = profiler.Register("Neighbors found", PE::CounterKind::Count);
+}
+
+void RecordSimCounters(const BoidSim & sim)
+{
+    PE::Profiler & profiler = PE::Profiler::GetInstance();
+    const SimPhaseTimes & times = sim.GetPhaseTimes();
+    profiler.Add(sim_counters.reorder, times.reorder);
+    profiler.Add(sim_counters.tree, times.tree);
+    profiler.Add(sim_counters.populate, times.populate);
+    profiler.Add(sim_counters.long_range, times.long_range);
+    profiler.Add(sim_counters.force, times.force);
+    profiler.Add(sim_counters.move, times.move);
+    profiler.Add(sim_counters.grid, times.grid);
+    
+    const SimCounters & counters = sim.GetCounters();
+    profiler.Add(sim_counters.lists_gathered, static_cast<double>(counters.populated));
+    profiler.Add(sim_counters.cells_scanned, static_cast<double>(counters.cells_scanned));
+    profiler.Add(sim_counters.candidates_checked, static_cast<double>(counters.candidates_checked));
+    profiler.Add(sim_counters.neighbors_found, static_cast<double>(counters.neighbors_found));
+}
+
 void GameInit(std::vector<std::string> cmd_args)
 {
+    for (size_t i = 1; i + 1 < cmd_args.size(); ++i)
+    {
+        if (cmd_args[i] == "--threads")
+            PE::ThreadPool::GetInstance().SetNumThreads(std::atoi(cmd_args[i + 1].c_str()));
+        else if (cmd_args[i] == "--tick-rate")
+            PE::SimClock::GetInstance().SetTickRate(static_cast<float>(std::atof(cmd_args[i + 1].c_str())));
+        else if (cmd_args[i] == "--seed")
+            PE::SetRandomSeed(std::strtoull(cmd_args[i + 1].c_str(), nullptr, 10));
+        else if (cmd_args[i] == "--trace-frames")
+        {
+            // Given as FIRST-LAST, e.g. 300-310.
+            const std::string & range = cmd_args[i + 1];
+            size_t dash = range.find('-');
+            uint first = static_cast<uint>(std::atoi(range.substr(0, dash).c_str()));
+            uint last = first;
+            if (dash != std::string::npos)
+                last = static_cast<uint>(std::atoi(range.substr(dash + 1).c_str()));
+            PE::Tracer::GetInstance().CaptureFrames(first, last, "boids_trace_" + range + ".json");
+        }
+    }
+    
+    // Print the seed so an interesting run can be replayed with --seed.
+    std::cout << "Random seed " << PE::GetRandomSeed() << std::endl;
+    
+    RegisterSimCounters();
+    
     // Set up Game UI
     game_ui = new GameUI();
     GameUI::SetInstance(game_ui);
@@ -49,6 +126,7 @@ void GameInit(std::vector<std::string> cmd_args)
     BoidsType1->FearFactor = 1000000;
     BoidsType1->BoidScale = PE::Vec3{.15f};
     BoidsType1->SetNeighborDistance(2);
+    BoidsType1->MortonSortInterval = 300;
     BoidsType1->AddBoids(DEFAULT_NUM_BOIDS);
     BoidsType1->AddBoidMaterial(PE::cyan_plastic);
     PE::Graphics::GetInstance()->AddModel(BoidsType1);
@@ -74,13 +152,51 @@ void GameInit(std::vector<std::string> cmd_args)
     BoidsType2->AddFearedBoids(BoidsType1);
 }
 
+void GameTick(float dt)
+{
+    PE::TraceZone zone("GameTick");
+    for (auto * bc : game_ui->BoidControllers)
+    {
+        bc->UpdateView();
+        bc->Update(dt);
+        RecordSimCounters(*bc);
+    }
+}
+
+// Starts a trace capture, or finishes the running one and writes it out.
+void ToggleTraceCapture()
+{
+    PE::Tracer & tracer = PE::Tracer::GetInstance();
+    if (!tracer.IsCapturing())
+    {
+        tracer.StartCapture();
+        std::cout << "Capturing trace, press F9 again to stop." << std::endl;
+        return;
+    }
+    
+    std::string path = "boids_trace_" + std::to_string(std::time(nullptr)) + ".json";
+    if (tracer.StopCapture(path))
+        std::cout << "Wrote trace to " << path << std::endl;
+    else
+        std::cout << "Couldn't write trace to " << path << std::endl;
+}
+
 bool GameLoop(float dt)
 {
     static float mouse_speed = 0.001f;
     static float cam_speed = 10;
     
-    for (auto * bc : game_ui->BoidControllers)
-        bc->Update(dt);
+    PE::TraceZone zone("GameLoop");
+    
+    // Draw boids partway between the last two ticks, so motion stays smooth
+    // whether the sim ticks faster or slower than frames are drawn.
+    float alpha = PE::SimClock::GetInstance().GetAlpha();
+    {
+        PE::ScopedTimer timer(sim_counters.render_data);
+        PE::TraceZone render_data_zone("UpdateRenderData");
+        for (auto * bc : game_ui->BoidControllers)
+            bc->UpdateRenderData(alpha);
+    }
     
     auto keystate = SDL_GetKeyboardState(nullptr);
     if (keystate[SDL_SCANCODE_W] || keystate[SDL_SCANCODE_UP])
@@ -161,6 +277,9 @@ bool GameLoop(float dt)
                         case SDLK_F7:
                             PE::Graphics::GetInstance()->debug_mode = 6;
                             break;
+                        case SDLK_F9:
+                            ToggleTraceCapture();
+                            break;
                         case SDLK_F12:
                             PE::Graphics::GetInstance()->CompileShaders();
                             break;
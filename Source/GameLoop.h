@@ -4,8 +4,12 @@
 
 #include <string>
 
+// Called once per rendered frame with the real time since the last one.
 bool GameLoop(float dt);
 
+// Called once per fixed simulation tick.
+void GameTick(float dt);
+
 void GameInit(std::vector<std::string> cmd_args);
 
 void GameShutdown();
@@ -1,8 +1,16 @@
 // Created by bushk on 8/15/2020.
 
 #include <imgui.h>
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <ctime>
+#include <thread>
 #include "GameUI.h"
 #include "Boids.h"
+#include "Engine/Profiler.h"
+#include "Engine/SimClock.h"
+#include "Engine/ThreadPool.h"
 
 GameUI * GameUI::instance = nullptr;
 
@@ -15,6 +23,9 @@ const float SpeedScale = 1.f;
 const float FearScale = .000002f;
 const float TurnForceScale = 1.f;
 
+// Buckets in the frame time histogram.
+const int FRAME_TIME_BUCKETS = 40;
+
 
 void SetColorsWhite(BoidController * bc)
 {
@@ -101,6 +112,14 @@ void DisplayBoidUI(BoidController * bc)
     ImGui::SliderFloat(label.c_str(), &scaled_cohesion_factor, 0, 10);
     bc->CohesionFactor = scaled_cohesion_factor / CohesionScale;
     
+    label = "Long Range (0 = off)##" + uid;
+    ImGui::SliderFloat(label.c_str(), &bc->LongRangeDistance, 0, 50, "%.1f");
+    if (bc->LongRangeDistance > 0)
+    {
+        label = "Opening Angle##" + uid;
+        ImGui::SliderFloat(label.c_str(), &bc->OpeningAngle, 0, 1, "%.2f");
+    }
+    
     float scaled_fear_factor = bc->FearFactor * FearScale;
     label = "Fear##" + uid;
     ImGui::SliderFloat(label.c_str(), &scaled_fear_factor, -10, 10);
@@ -151,23 +170,130 @@ void DisplayBoidUI(BoidController * bc)
     ImGui::SameLine();
     label = "Hard Barrier##" + uid;
     ImGui::Checkbox(label.c_str(), &bc->HardContainer);
+    ImGui::SameLine();
+    bool unbounded = bc->GetGridMode() == GridMode::Unbounded;
+    label = "Unbounded Grid##" + uid;
+    if (ImGui::Checkbox(label.c_str(), &unbounded))
+        bc->SetGridMode(unbounded ? GridMode::Unbounded : GridMode::Bounded);
     
     float scaled_area_size = bc->GetAreaSize() * AreaSizeScale;
     label = "Size##" + uid;
     ImGui::SliderFloat(label.c_str(), &scaled_area_size, 0.01, 10);
     bc->SetAreaSize(scaled_area_size / AreaSizeScale);
+    
+    ImGui::Text("Scheduling");
+    
+    label = "Sim Budget (ms, 0 = fixed)##" + uid;
+    ImGui::SliderFloat(label.c_str(), &bc->Scheduler.TargetMs, 0, 20, "%.1f");
+    
+    label = "Max Staleness (s)##" + uid;
+    ImGui::SliderFloat(label.c_str(), &bc->Scheduler.MaxStaleness, 0.1f, 5, "%.1f");
+    
+    ImGui::Text("Boids/tick: populate %u, force %u, grid %u", bc->populates_per_frame, bc->updates_per_frame,
+                bc->grid_updates_per_frame);
+    
+    bool verlet = bc->GetNeighborMode() == NeighborMode::Verlet;
+    label = "Verlet Lists##" + uid;
+    if (ImGui::Checkbox(label.c_str(), &verlet))
+        bc->SetNeighborMode(verlet ? NeighborMode::Verlet : NeighborMode::Staggered);
+    if (verlet)
+    {
+        float skin = bc->GetVerletSkin();
+        label = "Skin##" + uid;
+        if (ImGui::SliderFloat(label.c_str(), &skin, 0.1f, 4, "%.2f"))
+            bc->SetVerletSkin(skin);
+        
+        const SimStaleness & staleness = bc->GetStaleness();
+        ImGui::Text("List age: mean %.1f, max %u ticks, drift %.2f of skin", staleness.mean_age, staleness.max_age,
+                    staleness.max_drift);
+    }
+    
+    bool nearest = bc->GetNeighborMode() == NeighborMode::KNearest;
+    label = "Nearest Neighbors##" + uid;
+    if (ImGui::Checkbox(label.c_str(), &nearest))
+        bc->SetNeighborMode(nearest ? NeighborMode::KNearest : NeighborMode::Staggered);
+    if (nearest)
+    {
+        int neighbor_count = static_cast<int>(bc->GetNeighborCount());
+        label = "Neighbors##" + uid;
+        if (ImGui::SliderInt(label.c_str(), &neighbor_count, 1, KdTree::MAX_NEAREST))
+            bc->SetNeighborCount(static_cast<uint>(neighbor_count));
+    }
+    
+    label = "LOD Distance (0 = off)##" + uid;
+    ImGui::SliderFloat(label.c_str(), &bc->LodDistance, 0, 200, "%.0f");
+    if (bc->LodDistance > 0)
+    {
+        int lod_tiers = static_cast<int>(bc->LodTiers);
+        label = "LOD Tiers##" + uid;
+        if (ImGui::SliderInt(label.c_str(), &lod_tiers, 1, MAX_LOD_TIERS))
+            bc->LodTiers = static_cast<uint>(lod_tiers);
+        
+        const SimLodStats & lod = bc->GetLodStats();
+        std::string tiers = "Boids per tier:";
+        for (uint tier = 0; tier < bc->LodTiers && tier < MAX_LOD_TIERS; ++tier)
+            tiers += " " + std::to_string(lod.tiers[tier]);
+        ImGui::Text("%s", tiers.c_str());
+        ImGui::Text("Out of sight %u, headings updated %u", lod.out_of_sight, lod.updated);
+    }
+}
+
+void DisplayPerformanceUI(const PE::FrameTimeStats & stats)
+{
+    PE::Profiler & profiler = PE::Profiler::GetInstance();
+    
+    ImGui::Text("Frame time p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms", stats.p50, stats.p95, stats.p99,
+                stats.max);
+    
+    // Bucket frames by time, up to a little past the 99th percentile so one hitch doesn't squash the rest.
+    std::vector<float> frame_times;
+    profiler.GetFrameTimes(frame_times);
+    float range = std::max(stats.p99 * 1.25f, 1.f);
+    std::vector<float> buckets(FRAME_TIME_BUCKETS, 0.f);
+    for (float frame_ms : frame_times)
+    {
+        int bucket = static_cast<int>(frame_ms / range * FRAME_TIME_BUCKETS);
+        buckets[std::min(bucket, FRAME_TIME_BUCKETS - 1)] += 1;
+    }
+    std::string overlay = "0 - " + std::to_string(static_cast<int>(std::ceil(range))) + " ms";
+    ImGui::PlotHistogram("Frame Times", buckets.data(), FRAME_TIME_BUCKETS, 0, overlay.c_str(), 0, FLT_MAX,
+                         ImVec2(0, 80));
+    ImGui::PlotLines("Frame History", frame_times.data(), static_cast<int>(frame_times.size()), 0, nullptr, 0,
+                     FLT_MAX, ImVec2(0, 60));
+    
+    // One graph per counter, labelled with its average.
+    std::vector<float> history;
+    char average[64];
+    for (uint counter = 0; counter < profiler.GetNumCounters(); ++counter)
+    {
+        profiler.GetHistory(counter, history);
+        if (profiler.GetKind(counter) == PE::CounterKind::Time)
+            std::snprintf(average, sizeof(average), "avg %.3f ms", profiler.GetAverage(counter));
+        else
+            std::snprintf(average, sizeof(average), "avg %.0f", profiler.GetAverage(counter));
+        ImGui::PlotLines(profiler.GetName(counter).c_str(), history.data(), static_cast<int>(history.size()), 0,
+                         average, 0, FLT_MAX, ImVec2(0, 40));
+    }
+    
+    static std::string dump_result;
+    if (ImGui::Button("Dump CSV"))
+    {
+        std::string path = "boids_profile_" + std::to_string(std::time(nullptr)) + ".csv";
+        if (profiler.WriteCsv(path))
+            dump_result = "Wrote " + path;
+        else
+            dump_result = "Couldn't write " + path;
+    }
+    if (!dump_result.empty())
+    {
+        ImGui::SameLine();
+        ImGui::Text("%s", dump_result.c_str());
+    }
 }
 
 void GameUI::UpdateGameUI()
 {
-    static std::vector<float> FPS(100, 60);
-    static uint FPS_index = 0;
-    FPS[FPS_index] = ImGui::GetIO().Framerate;
-    FPS_index = (FPS_index + 1) % 100;
-    float avg_fps = 0;
-    for (float fps : FPS)
-        avg_fps += fps;
-    avg_fps /= 100;
+    PE::FrameTimeStats stats = PE::Profiler::GetInstance().GetFrameStats();
     
     ImGui::Begin("Control Panel");
     
@@ -175,7 +301,22 @@ void GameUI::UpdateGameUI()
     
     ImGui::Spacing();
     
-    ImGui::Text("Average performance: %.1f ms/frame (%.1f FPS)", 1000.f / avg_fps, avg_fps);
+    if (stats.mean > 0)
+        ImGui::Text("Average performance: %.1f ms/frame (%.1f FPS)", stats.mean, 1000.f / stats.mean);
+    
+    if (ImGui::CollapsingHeader("Performance"))
+        DisplayPerformanceUI(stats);
+    
+    PE::ThreadPool & pool = PE::ThreadPool::GetInstance();
+    int num_threads = pool.GetNumThreads();
+    int max_threads = std::max(std::thread::hardware_concurrency(), pool.GetNumThreads());
+    ImGui::SliderInt("Worker Threads", &num_threads, 1, max_threads);
+    pool.SetNumThreads(num_threads);
+    
+    PE::SimClock & sim_clock = PE::SimClock::GetInstance();
+    float tick_rate = sim_clock.GetTickRate();
+    if (ImGui::SliderFloat("Sim Ticks/Second", &tick_rate, 10, 240, "%.0f"))
+        sim_clock.SetTickRate(tick_rate);
     
     for (auto * bc : BoidControllers)
     {
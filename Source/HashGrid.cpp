@@ -0,0 +1,189 @@
+#include <cmath>
+#include "HashGrid.h"
+
+// Each axis is packed into 21 bits of the key. Boids further than 2^20 cells
+// from the origin are clamped into the outermost cells and share them, which
+// only costs extra distance checks since every candidate is range checked anyway.
+static const int AXIS_BITS = 21;
+static const CellKey AXIS_MASK = (CellKey(1) << AXIS_BITS) - 1;
+static const int AXIS_BIAS = 1 << (AXIS_BITS - 1);
+
+// Never produced by PackCell, since the top bit of a key is always clear.
+static const CellKey EMPTY_KEY = ~CellKey(0);
+
+static const uint MIN_TABLE_SIZE = 64;
+
+static CellKey PackCell(int x, int y, int z)
+{
+    return (CellKey(x + AXIS_BIAS) & AXIS_MASK) |
+           ((CellKey(y + AXIS_BIAS) & AXIS_MASK) << AXIS_BITS) |
+           ((CellKey(z + AXIS_BIAS) & AXIS_MASK) << (AXIS_BITS * 2));
+}
+
+// Cell an axis of a position falls in. Converting a float past the range of an int, or NaN,
+// is undefined, so the cell is clamped to the packable range first. NaN goes to the low end.
+static int CellCoordinate(float position, float inverse_cell_size)
+{
+    float cell = std::floor(position * inverse_cell_size);
+    if (!(cell >= -AXIS_BIAS))
+        return -AXIS_BIAS;
+    if (cell > AXIS_BIAS - 1)
+        return AXIS_BIAS - 1;
+    return static_cast<int>(cell);
+}
+
+static uint HashKey(CellKey key)
+{
+    // Fibonacci hashing spreads neighboring cells across the table.
+    return static_cast<uint>((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+void HashGrid::SetCellSize(float size)
+{
+    cell_size = size;
+    inverse_cell_size = 1.f / size;
+}
+
+CellKey HashGrid::GetKey(const PE::Vec3 & position) const
+{
+    return PackCell(CellCoordinate(position.x, inverse_cell_size), CellCoordinate(position.y, inverse_cell_size),
+                    CellCoordinate(position.z, inverse_cell_size));
+}
+
+uint HashGrid::FindSlot(CellKey key) const
+{
+    uint slot = HashKey(key) & table_mask;
+    while (table[slot].key != key && table[slot].key != EMPTY_KEY)
+        slot = (slot + 1) & table_mask;
+    return slot;
+}
+
+void HashGrid::Rehash(uint capacity)
+{
+    std::vector<Slot> old_table;
+    old_table.swap(table);
+    
+    table.assign(capacity, Slot{EMPTY_KEY, 0});
+    table_mask = capacity - 1;
+    for (const Slot & slot : old_table)
+        if (slot.key != EMPTY_KEY)
+            table[FindSlot(slot.key)] = slot;
+}
+
+uint HashGrid::FindOrAddCell(CellKey key)
+{
+    if (table.empty())
+        Rehash(MIN_TABLE_SIZE);
+    
+    uint slot = FindSlot(key);
+    if (table[slot].key == EMPTY_KEY)
+    {
+        table[slot] = Slot{key, buckets.AddCell()};
+        ++num_cells;
+        
+        // Keep the load factor at or below one half.
+        if (num_cells * 2 > table.size())
+        {
+            Rehash(static_cast<uint>(table.size()) * 2);
+            slot = FindSlot(key);
+        }
+    }
+    return table[slot].cell;
+}
+
+void HashGrid::ReleaseIfEmpty(CellKey key, uint cell)
+{
+    if (buckets.Count(cell) != 0)
+        return;
+    EraseSlot(FindSlot(key));
+    buckets.FreeCell(cell);
+    --num_cells;
+}
+
+void HashGrid::EraseSlot(uint slot)
+{
+    // Shift later entries of the probe run back over the hole wherever that
+    // doesn't move them before their home slot, so lookups never stop short.
+    uint hole = slot;
+    for (uint next = (hole + 1) & table_mask; table[next].key != EMPTY_KEY; next = (next + 1) & table_mask)
+    {
+        uint home = HashKey(table[next].key) & table_mask;
+        if (((next - home) & table_mask) >= ((next - hole) & table_mask))
+        {
+            table[hole] = table[next];
+            hole = next;
+        }
+    }
+    table[hole].key = EMPTY_KEY;
+}
+
+void HashGrid::Build(const CellKey * keys, uint count)
+{
+    // Size the table off the last build's occupancy and grow as cells turn up.
+    uint capacity = MIN_TABLE_SIZE;
+    while (capacity < num_cells * 2)
+        capacity *= 2;
+    Clear();
+    Rehash(capacity);
+    
+    for (uint i = 0; i < count; ++i)
+        buckets.Add(FindOrAddCell(keys[i]));
+}
+
+void HashGrid::Insert(const CellKey * keys, uint first, uint count)
+{
+    for (uint i = first; i < first + count; ++i)
+        buckets.Add(FindOrAddCell(keys[i]));
+}
+
+void HashGrid::Move(uint boid, CellKey from, CellKey to)
+{
+    uint left = buckets.Move(boid, FindOrAddCell(to));
+    ReleaseIfEmpty(from, left);
+}
+
+void HashGrid::SwapRemove(uint boid, CellKey key)
+{
+    ReleaseIfEmpty(key, buckets.SwapRemove(boid));
+}
+
+void HashGrid::Clear()
+{
+    table.clear();
+    table_mask = 0;
+    num_cells = 0;
+    buckets.Clear();
+}
+
+IndexSpan HashGrid::GetCell(CellKey key) const
+{
+    if (table.empty())
+        return IndexSpan{nullptr, nullptr};
+    
+    const Slot & slot = table[FindSlot(key)];
+    if (slot.key == EMPTY_KEY)
+        return IndexSpan{nullptr, nullptr};
+    return buckets.Get(slot.cell);
+}
+
+void HashGrid::GatherCells(const PE::Vec3 & position, uint reach, std::vector<IndexSpan> & cells) const
+{
+    int x = CellCoordinate(position.x, inverse_cell_size);
+    int y = CellCoordinate(position.y, inverse_cell_size);
+    int z = CellCoordinate(position.z, inverse_cell_size);
+    int r = static_cast<int>(reach);
+    
+    for (int dz = -r; dz <= r; ++dz)
+        for (int dy = -r; dy <= r; ++dy)
+            for (int dx = -r; dx <= r; ++dx)
+            {
+                IndexSpan cell = GetCell(PackCell(x + dx, y + dy, z + dz));
+                if (!cell.empty())
+                    cells.emplace_back(cell);
+            }
+}
+
+float HashGrid::GetCellSize() const
+{
+    return cell_size;
+}
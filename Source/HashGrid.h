@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include "Engine/Types.h"
+#include "SpatialIndex.h"
+#include "CellBuckets.h"
+
+/*!
+@brief Sparse spatial index over unbounded space. Positions are quantized
+   to cubic cells, and only occupied cells are stored, in an open-addressing
+   hash table keyed by the cell's coordinates that gives each cell's bucket
+   of boids. Memory is proportional to the number of occupied cells no
+   matter how far apart the boids are.
+*/
+class HashGrid : public SpatialIndex
+{
+public:
+    void SetCellSize(float size);
+    
+    [[nodiscard]] CellKey GetKey(const PE::Vec3 & position) const override;
+    
+    void Build(const CellKey * keys, uint count) override;
+    void Insert(const CellKey * keys, uint first, uint count) override;
+    void Move(uint boid, CellKey from, CellKey to) override;
+    void SwapRemove(uint boid, CellKey key) override;
+    void Clear() override;
+    
+    void GatherCells(const PE::Vec3 & position, uint reach, std::vector<IndexSpan> & cells) const override;
+    
+    [[nodiscard]] IndexSpan GetAll() const override
+    { return buckets.GetAll(); }
+    
+    [[nodiscard]] float GetCellSize() const override;
+    
+    [[nodiscard]] IndexSpan GetCell(CellKey key) const;
+    
+    [[nodiscard]] uint GetNumCells() const
+    { return num_cells; }
+    
+private:
+    struct Slot
+    {
+        CellKey key;
+        uint cell;
+    };
+    
+    // Index of the slot holding key, or of the empty slot where it belongs.
+    [[nodiscard]] uint FindSlot(CellKey key) const;
+    
+    // Bucket of key, adding the cell if it's new.
+    uint FindOrAddCell(CellKey key);
+    
+    // Drops the key's cell if the last boid just left its bucket.
+    void ReleaseIfEmpty(CellKey key, uint cell);
+    void EraseSlot(uint slot);
+    void Rehash(uint capacity);
+    
+    float cell_size = 1;
+    float inverse_cell_size = 1;
+    
+    // Power of two sized table of occupied cells.
+    std::vector<Slot> table;
+    uint table_mask = 0;
+    uint num_cells = 0;
+    
+    CellBuckets buckets;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Engine/Types.h"
+
+// Read-only view of a contiguous run of boid indices.
+struct IndexSpan
+{
+    const uint * first;
+    const uint * last;
+    
+    [[nodiscard]] const uint * begin() const
+    { return first; }
+    
+    [[nodiscard]] const uint * end() const
+    { return last; }
+    
+    [[nodiscard]] uint size() const
+    { return static_cast<uint>(last - first); }
+    
+    [[nodiscard]] bool empty() const
+    { return first == last; }
+    
+    uint operator[](uint i) const
+    { return first[i]; }
+};
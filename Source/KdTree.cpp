@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "KdTree.h"
+#include "Engine/ThreadPool.h"
+
+// Ranges this small are scanned rather than split.
+static const uint LEAF_SIZE = 8;
+
+// Split the top of the tree one level at a time across threads until there are
+// this many subtrees, then build each subtree whole on one thread.
+static const uint PARALLEL_SUBTREES = 64;
+
+static const uint BUILD_CHUNK_SIZE = 4096;
+
+// Past this many more boids crossing a split one way than the other, partition the range again instead.
+static const int MAX_UNEVEN_CROSSINGS = 128;
+
+// Deep enough for two entries per level of a tree over every index a uint can hold.
+static const uint SEARCH_STACK_SIZE = 64;
+
+// Slack on a search radius carried over from the previous query, against rounding.
+static const float CARRIED_BOUND_SLACK = 1.0001f;
+
+void KdTree::Build(const BoidStorage & boids)
+{
+    PE::ThreadPool & pool = PE::ThreadPool::GetInstance();
+    uint num_boids = boids.Size();
+    reuse_order = points.size() == num_boids;
+    if (!reuse_order)
+    {
+        points.resize(num_boids);
+        for (uint boid = 0; boid < num_boids; ++boid)
+            points[boid].boid = boid;
+    }
+    axes.resize(num_boids);
+    point_of.resize(num_boids);
+    pool.ParallelFor(num_boids, BUILD_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        for (uint i = begin; i < end; ++i)
+        {
+            PE::Vec3 position = boids.GetPosition(points[i].boid);
+            points[i].position[0] = position.x;
+            points[i].position[1] = position.y;
+            points[i].position[2] = position.z;
+        }
+    });
+
+    // Each level's ranges split independently, so a level is one parallel loop.
+    std::vector<Range> ranges{Range{0, num_boids}};
+    std::vector<Range> children;
+    std::vector<std::uint8_t> was_split;
+    while (!ranges.empty() && ranges.size() < PARALLEL_SUBTREES)
+    {
+        was_split.assign(ranges.size(), 0);
+        pool.ParallelFor(static_cast<uint>(ranges.size()), 1, [&](uint begin, uint end)
+        {
+            for (uint i = begin; i < end; ++i)
+                was_split[i] = Split(ranges[i]);
+        });
+
+        children.clear();
+        for (uint i = 0; i < ranges.size(); ++i)
+        {
+            if (!was_split[i])
+                continue;
+            uint middle = (ranges[i].first + ranges[i].last) / 2;
+            children.emplace_back(Range{ranges[i].first, middle});
+            children.emplace_back(Range{middle + 1, ranges[i].last});
+        }
+        ranges.swap(children);
+    }
+
+    pool.ParallelFor(static_cast<uint>(ranges.size()), 1, [&](uint begin, uint end)
+    {
+        for (uint i = begin; i < end; ++i)
+            BuildSubtree(ranges[i]);
+    });
+
+    pool.ParallelFor(num_boids, BUILD_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        for (uint i = begin; i < end; ++i)
+            point_of[points[i].boid] = i;
+    });
+}
+
+void KdTree::Clear()
+{
+    points.clear();
+}
+
+bool KdTree::Split(Range range)
+{
+    if (range.last - range.first <= LEAF_SIZE)
+        return false;
+
+    uint middle = (range.first + range.last) / 2;
+    if (reuse_order && Resplit(range, middle))
+        return true;
+
+    // Split across the widest extent, so clustered flocks still get compact ranges.
+    float low[3], high[3];
+    for (uint axis = 0; axis < 3; ++axis)
+    {
+        low[axis] = std::numeric_limits<float>::max();
+        high[axis] = std::numeric_limits<float>::lowest();
+    }
+    for (uint i = range.first; i < range.last; ++i)
+        for (uint axis = 0; axis < 3; ++axis)
+        {
+            low[axis] = std::min(low[axis], points[i].position[axis]);
+            high[axis] = std::max(high[axis], points[i].position[axis]);
+        }
+    uint axis = 0;
+    for (uint other = 1; other < 3; ++other)
+        if (high[other] - low[other] > high[axis] - low[axis])
+            axis = other;
+
+    std::nth_element(points.begin() + range.first, points.begin() + middle, points.begin() + range.last,
+                     [axis](const Point & a, const Point & b) { return a.position[axis] < b.position[axis]; });
+    axes[middle] = static_cast<std::uint8_t>(axis);
+    return true;
+}
+
+bool KdTree::Resplit(Range range, uint middle)
+{
+    // Keep the last build's axis and trade boids that crossed its split one for one.
+    uint axis = axes[middle];
+    float split = points[middle].position[axis];
+    uint low = range.first;
+    uint high = range.last - 1;
+    while (true)
+    {
+        while (low < middle && points[low].position[axis] <= split)
+            ++low;
+        while (high > middle && points[high].position[axis] >= split)
+            --high;
+        if (low == middle || high == middle)
+            break;
+        std::swap(points[low++], points[high--]);
+    }
+    if (low == middle && high == middle)
+        return true;
+
+    // The rest crossed from one side, the near side. Flip positions there so that
+    // crossers always have a larger key than the split, whichever side it is.
+    int outward = low < middle ? -1 : 1;
+    float sign = low < middle ? 1.0f : -1.0f;
+    int near_end = low < middle ? static_cast<int>(range.first) - 1 : static_cast<int>(range.last);
+    int far_end = low < middle ? static_cast<int>(range.last) : static_cast<int>(range.first) - 1;
+    auto key = [&](int i) { return sign * points[i].position[axis]; };
+    float split_key = sign * split;
+
+    // Gather the crossers next to the middle and move the middle boid out past them.
+    int gathered = static_cast<int>(middle);
+    for (int i = gathered + outward; i != near_end; i += outward)
+        if (key(i) > split_key)
+        {
+            gathered += outward;
+            std::swap(points[i], points[gathered]);
+        }
+    if (std::abs(gathered - static_cast<int>(middle)) > MAX_UNEVEN_CROSSINGS)
+        return false;
+    std::swap(points[middle], points[gathered]);
+
+    // The entries from the middle to just short of the old middle boid now need the
+    // smallest keys among the crossers and the far side, the largest of them in the middle.
+    auto largest = [&]()
+    {
+        int index = static_cast<int>(middle);
+        for (int i = index + outward; i != gathered; i += outward)
+            if (key(i) > key(index))
+                index = i;
+        return index;
+    };
+    int kept = largest();
+    for (int i = static_cast<int>(middle) - outward; i != far_end; i -= outward)
+        if (key(i) < key(kept))
+        {
+            std::swap(points[i], points[kept]);
+            kept = largest();
+        }
+    std::swap(points[kept], points[middle]);
+    return true;
+}
+
+void KdTree::BuildSubtree(Range range)
+{
+    if (!Split(range))
+        return;
+
+    uint middle = (range.first + range.last) / 2;
+    BuildSubtree(Range{range.first, middle});
+    BuildSubtree(Range{middle + 1, range.last});
+}
+
+std::uint64_t KdTree::FindNearest(const uint * boids, uint count, uint k, std::vector<uint> & out,
+                                  std::vector<uint> & counts) const
+{
+    if (k > MAX_NEAREST)
+        k = MAX_NEAREST;
+    uint nearest[MAX_NEAREST];
+    float distances[MAX_NEAREST];
+    std::uint64_t checked = 0;
+
+    const float * last_position = nullptr;
+    float last_reach = 0;
+    for (uint query = 0; query < count; ++query)
+    {
+        const float * position = points[point_of[boids[query]]].position;
+
+        // The previous boid's k neighbors are all within its reach plus the distance between
+        // the two, and only one of them can be this boid, which the previous boid replaces.
+        float bound_squared = std::numeric_limits<float>::max();
+        if (last_position)
+        {
+            float dx = position[0] - last_position[0];
+            float dy = position[1] - last_position[1];
+            float dz = position[2] - last_position[2];
+            float bound = last_reach + std::sqrt(dx * dx + dy * dy + dz * dz);
+            bound_squared = bound * bound * CARRIED_BOUND_SLACK;
+        }
+
+        uint found = Search(position, boids[query], k, bound_squared, nearest, distances, checked);
+        // Boids sharing a position don't count as neighbors, so the carried bound can come up short.
+        if (found < k && last_position)
+            found = Search(position, boids[query], k, std::numeric_limits<float>::max(), nearest, distances,
+                           checked);
+
+        out.insert(out.end(), nearest, nearest + found);
+        counts.emplace_back(found);
+
+        // Only a full answer bounds the next query.
+        last_position = found == k ? position : nullptr;
+        last_reach = found == k ? std::sqrt(distances[k - 1]) : 0;
+    }
+    return checked;
+}
+
+uint KdTree::Search(const float * position, uint self, uint k, float bound_squared, uint * nearest,
+                    float * distances, std::uint64_t & checked) const
+{
+    uint found = 0;
+    if (k == 0)
+        return 0;
+
+    // Keeps the best found so far sorted, nearest first.
+    auto consider = [&](const Point & point)
+    {
+        ++checked;
+        float dx = point.position[0] - position[0];
+        float dy = point.position[1] - position[1];
+        float dz = point.position[2] - position[2];
+        float distance_squared = dx * dx + dy * dy + dz * dz;
+        float worst = found == k ? distances[k - 1] : bound_squared;
+        if (distance_squared >= worst || distance_squared == 0 || point.boid == self)
+            return;
+
+        uint slot = found == k ? k - 1 : found++;
+        while (slot > 0 && distances[slot - 1] > distance_squared)
+        {
+            distances[slot] = distances[slot - 1];
+            nearest[slot] = nearest[slot - 1];
+            --slot;
+        }
+        distances[slot] = distance_squared;
+        nearest[slot] = point.boid;
+    };
+
+    // Ranges still to visit, with the squared distance to the plane that separates each from the query.
+    struct Pending
+    {
+        Range range;
+        float plane_distance_squared;
+    };
+    Pending stack[SEARCH_STACK_SIZE];
+    uint depth = 0;
+    stack[depth++] = Pending{Range{0, static_cast<uint>(points.size())}, 0};
+    while (depth)
+    {
+        Pending pending = stack[--depth];
+        float worst = found == k ? distances[k - 1] : bound_squared;
+        if (pending.plane_distance_squared >= worst)
+            continue;
+
+        Range range = pending.range;
+        if (range.last - range.first <= LEAF_SIZE)
+        {
+            for (uint i = range.first; i < range.last; ++i)
+                consider(points[i]);
+            continue;
+        }
+
+        uint middle = (range.first + range.last) / 2;
+        consider(points[middle]);
+
+        // Visit the side the query is on first, the far side only if it's still close enough.
+        float offset = position[axes[middle]] - points[middle].position[axes[middle]];
+        Range lower{range.first, middle};
+        Range upper{middle + 1, range.last};
+        stack[depth++] = Pending{offset < 0 ? upper : lower, offset * offset};
+        stack[depth++] = Pending{offset < 0 ? lower : upper, pending.plane_distance_squared};
+    }
+    return found;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Engine/Types.h"
+#include "BoidStorage.h"
+
+/*!
+@brief Implicit KD-tree over boid positions for k-nearest neighbor queries.
+   There are no node objects: the tree is one array of points, each range
+   split at its middle entry along its widest axis, so the two halves of a
+   range are its children and nearby boids sit next to each other in memory.
+   Ranges of a few boids are left as leaves and scanned whole.
+*/
+class KdTree
+{
+public:
+    // Most neighbors one query can return.
+    static const uint MAX_NEAREST = 32;
+
+    /*!
+    @brief Rebuilds the tree from the boids' current positions, splitting
+       the work across the thread pool. Boids move little between builds,
+       so each build starts from the last one's order and splits: only the
+       few boids that crossed a split are moved, in linear passes, and a
+       range is partitioned from scratch only when too many crossed it.
+    */
+    void Build(const BoidStorage & boids);
+
+    // Forgets the last build's order, for when boids were reordered and it no longer fits them.
+    void Clear();
+
+    /*!
+    @brief Finds up to k nearest other boids to each of count boids, nearest
+       first, appending them to out and how many were found to counts.
+       Consecutive queries in a batch should be close to each other, each
+       search starts from a radius implied by the previous answer.
+    @return The number of points whose distance was checked.
+    */
+    std::uint64_t FindNearest(const uint * boids, uint count, uint k, std::vector<uint> & out,
+                              std::vector<uint> & counts) const;
+
+private:
+    struct Point
+    {
+        float position[3];
+        uint boid;
+    };
+
+    struct Range
+    {
+        uint first;
+        uint last;
+    };
+
+    // Splits a range around its middle point and returns whether it was big enough to split.
+    bool Split(Range range);
+
+    // Restores the last build's split of a range if few boids crossed it. Returns false when it couldn't.
+    bool Resplit(Range range, uint middle);
+    void BuildSubtree(Range range);
+
+    // Finds up to k nearest points to position within sqrt(bound_squared), nearest first.
+    uint Search(const float * position, uint self, uint k, float bound_squared, uint * nearest,
+                float * distances, std::uint64_t & checked) const;
+
+    std::vector<Point> points;
+
+    // Split axis of the range whose middle entry is at each index. Unused for leaves.
+    std::vector<std::uint8_t> axes;
+
+    // Where each boid's point ended up.
+    std::vector<uint> point_of;
+
+    // Whether points are in the last build's order, with its axes.
+    bool reuse_order = false;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include "Engine/Types.h"
+
+// Spreads the low 21 bits of v so there are two zero bits between each.
+inline std::uint64_t SpreadBits(std::uint64_t v)
+{
+    v &= 0x1FFFFF;
+    v = (v | v << 32) & 0x1F00000000FFFFull;
+    v = (v | v << 16) & 0x1F0000FF0000FFull;
+    v = (v | v << 8) & 0x100F00F00F00F00Full;
+    v = (v | v << 4) & 0x10C30C30C30C30C3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+// Z-order curve index of a cell. Cells close together in space mostly get
+// codes close together, so sorting by code clusters spatial neighbors.
+inline std::uint64_t MortonCode(uint x, uint y, uint z)
+{
+    return SpreadBits(x) | SpreadBits(y) << 1 | SpreadBits(z) << 2;
+}
+
+// Morton code of the cell of the given size containing a position.
+inline std::uint64_t MortonCode(const PE::Vec3 & position, float inverse_cell_size)
+{
+    // Bias into the positive range covered by 21 bits per axis.
+    const int bias = 1 << 20;
+    return MortonCode(static_cast<uint>(static_cast<int>(std::floor(position.x * inverse_cell_size)) + bias),
+                      static_cast<uint>(static_cast<int>(std::floor(position.y * inverse_cell_size)) + bias),
+                      static_cast<uint>(static_cast<int>(std::floor(position.z * inverse_cell_size)) + bias));
+}
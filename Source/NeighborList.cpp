@@ -0,0 +1,111 @@
+#include "NeighborList.h"
+
+// Pools smaller than this are never worth compacting.
+static const size_t MIN_COMPACT_SIZE = 4096;
+
+void NeighborList::Resize(uint num_rows)
+{
+    // Dropped rows no longer hold live entries.
+    for (uint row = num_rows; row < NumRows(); ++row)
+        live -= counts[row];
+
+    offsets.resize(num_rows, static_cast<uint>(pool.size()));
+    counts.resize(num_rows, 0);
+    stamps.resize(num_rows, 0);
+}
+
+void NeighborList::Clear()
+{
+    offsets.clear();
+    counts.clear();
+    stamps.clear();
+    pool.clear();
+    live = 0;
+}
+
+void NeighborList::BeginRow(uint row)
+{
+    open_row = row;
+    live -= counts[row];
+    offsets[row] = static_cast<uint>(pool.size());
+}
+
+void NeighborList::EndRow()
+{
+    counts[open_row] = static_cast<uint>(pool.size()) - offsets[open_row];
+    live += counts[open_row];
+
+    if (pool.size() > MIN_COMPACT_SIZE && pool.size() > live * 2)
+        Compact();
+}
+
+void NeighborList::Assign(uint row, const uint * values, uint count)
+{
+    BeginRow(row);
+    pool.insert(pool.end(), values, values + count);
+    EndRow();
+}
+
+void NeighborList::MoveRow(uint from, uint to)
+{
+    live -= counts[to];
+    offsets[to] = offsets[from];
+    counts[to] = counts[from];
+    stamps[to] = stamps[from];
+    counts[from] = 0;
+}
+
+void NeighborList::Permute(const std::vector<uint> & order, const std::vector<uint> * remap)
+{
+    std::vector<uint> new_offsets(order.size());
+    std::vector<uint> new_counts(order.size());
+    std::vector<uint> new_stamps(order.size());
+    
+    // Rebuilding into row order compacts the pool as a side effect.
+    compact_pool.clear();
+    compact_pool.reserve(live);
+    for (uint row = 0; row < order.size(); ++row)
+    {
+        uint old_row = order[row];
+        uint start = offsets[old_row];
+        new_offsets[row] = static_cast<uint>(compact_pool.size());
+        new_counts[row] = counts[old_row];
+        new_stamps[row] = stamps[old_row];
+        for (uint i = start; i < start + counts[old_row]; ++i)
+        {
+            uint value = pool[i];
+            if (remap && value < remap->size())
+                value = (*remap)[value];
+            compact_pool.emplace_back(value);
+        }
+    }
+    
+    pool.swap(compact_pool);
+    offsets.swap(new_offsets);
+    counts.swap(new_counts);
+    stamps.swap(new_stamps);
+}
+
+void NeighborList::RemapValues(const std::vector<uint> & remap)
+{
+    // Only touch live rows, abandoned slices may hold anything.
+    for (uint row = 0; row < NumRows(); ++row)
+        for (uint i = offsets[row]; i < offsets[row] + counts[row]; ++i)
+            if (pool[i] < remap.size())
+                pool[i] = remap[pool[i]];
+}
+
+void NeighborList::Compact()
+{
+    // Copy every row back into row order, which also makes a full sweep
+    // over all rows a single linear read of the pool.
+    compact_pool.clear();
+    compact_pool.reserve(live);
+    for (uint row = 0; row < NumRows(); ++row)
+    {
+        uint start = offsets[row];
+        offsets[row] = static_cast<uint>(compact_pool.size());
+        compact_pool.insert(compact_pool.end(), pool.begin() + start, pool.begin() + start + counts[row]);
+    }
+    pool.swap(compact_pool);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "Engine/Types.h"
+#include "IndexSpan.h"
+
+/*!
+@brief Compressed-sparse-row list of boid indices, one row per boid.
+   All rows share a single index pool. Rewriting a row appends its new
+   contents to the end of the pool and abandons the old slice; once the
+   abandoned entries outweigh the live ones the pool is compacted back into
+   row order. Rebuilding rows therefore never allocates per boid.
+*/
+class NeighborList
+{
+public:
+    using Row = IndexSpan;
+
+    // Grows or shrinks the number of rows. New rows are empty.
+    void Resize(uint num_rows);
+    void Clear();
+
+    [[nodiscard]] uint NumRows() const
+    { return static_cast<uint>(offsets.size()); }
+
+    [[nodiscard]] Row Get(uint row) const
+    {
+        const uint * first = pool.data() + offsets[row];
+        return Row{first, first + counts[row]};
+    }
+
+    // Rewrite a row in place: BeginRow, any number of Push calls, then EndRow.
+    // Only one row may be open at a time.
+    void BeginRow(uint row);
+
+    void Push(uint value)
+    { pool.emplace_back(value); }
+
+    void EndRow();
+
+    // Replace a row's contents with a prebuilt set of indices.
+    void Assign(uint row, const uint * values, uint count);
+
+    // Slot map epoch of the indexed boids when the row was written, 0 until it is.
+    [[nodiscard]] uint GetStamp(uint row) const
+    { return stamps[row]; }
+
+    void SetStamp(uint row, uint stamp)
+    { stamps[row] = stamp; }
+
+    // Moves row from into row to, dropping to's contents and leaving from empty.
+    void MoveRow(uint from, uint to);
+
+    // Reorders rows so old row order[i] becomes row i. If remap is given,
+    // each stored value v is also replaced with remap[v], as in RemapValues.
+    void Permute(const std::vector<uint> & order, const std::vector<uint> * remap);
+
+    // Replaces each stored value v with remap[v]. Values outside the
+    // remap table are left alone.
+    void RemapValues(const std::vector<uint> & remap);
+
+private:
+    void Compact();
+
+    std::vector<uint> offsets;
+    std::vector<uint> counts;
+    std::vector<uint> stamps;
+    std::vector<uint> pool;
+
+    // Compaction target, kept around so its capacity is reused.
+    std::vector<uint> compact_pool;
+
+    // Number of pool entries referenced by some row.
+    size_t live = 0;
+    uint open_row = 0;
+};
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <limits>
+#include "Octree.h"
+#include "Morton.h"
+#include "Engine/ThreadPool.h"
+
+// Levels below the root. The finest cells split the flock's bounds this many times along each axis.
+static const uint LEVELS = 10;
+
+// Nodes this small are leaves, their points checked one by one.
+static const uint LEAF_SIZE = 8;
+
+static const uint BUILD_CHUNK_SIZE = 4096;
+
+// Average distance each key may move while insertion sorting before a full sort takes over.
+static const std::uint64_t INSERTION_SORT_BUDGET = 4;
+
+// Boids that walk the tree together, the most a node can hold and still be one group.
+static const uint GROUP_SIZE = 32;
+
+// Groups gathered per task.
+static const uint GATHER_CHUNK_SIZE = 8;
+
+// Each level opened leaves at most seven siblings waiting.
+static const uint GATHER_STACK_SIZE = 8 * (LEVELS + 1);
+
+// Bounds grow by this much so boids on the far edge still fall in the last cell.
+static const float BOUNDS_PADDING = 1.001f;
+static const float MIN_BOUNDS_SIZE = 0.001f;
+
+// How near a node may come to a group's boids and still count as apart from them, as a share
+// of the node's size. Rounding can put a boid a hair outside the cube its code placed it in.
+static const float INSIDE_SLACK = 0.001f;
+
+static const std::uint64_t BOID_MASK = 0xFFFFFFFF;
+
+void Octree::Build(const BoidStorage & boids)
+{
+    PE::ThreadPool & pool = PE::ThreadPool::GetInstance();
+    uint num_boids = boids.Size();
+    nodes.clear();
+    groups.clear();
+    if (num_boids == 0)
+    {
+        keys.clear();
+        points.clear();
+        return;
+    }
+
+    // Bounds of the flock, made a cube so each level halves every axis alike.
+    uint num_chunks = (num_boids + BUILD_CHUNK_SIZE - 1) / BUILD_CHUNK_SIZE;
+    std::vector<PE::Vec3> chunk_lows(num_chunks), chunk_highs(num_chunks);
+    pool.ParallelFor(num_boids, BUILD_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        PE::Vec3 low{std::numeric_limits<float>::max()};
+        PE::Vec3 high{std::numeric_limits<float>::lowest()};
+        for (uint i = begin; i < end; ++i)
+        {
+            low = glm::min(low, boids.GetPosition(i));
+            high = glm::max(high, boids.GetPosition(i));
+        }
+        chunk_lows[begin / BUILD_CHUNK_SIZE] = low;
+        chunk_highs[begin / BUILD_CHUNK_SIZE] = high;
+    });
+    PE::Vec3 low = chunk_lows[0];
+    PE::Vec3 high = chunk_highs[0];
+    for (uint chunk = 1; chunk < num_chunks; ++chunk)
+    {
+        low = glm::min(low, chunk_lows[chunk]);
+        high = glm::max(high, chunk_highs[chunk]);
+    }
+    PE::Vec3 extent = high - low;
+    float size = std::max(std::max(extent.x, extent.y), extent.z) * BOUNDS_PADDING;
+    size = std::max(size, MIN_BOUNDS_SIZE);
+
+    // Sort by Morton code, starting from the last build's order so the sort mostly finds it in place.
+    if (keys.size() != num_boids)
+    {
+        keys.resize(num_boids);
+        for (uint boid = 0; boid < num_boids; ++boid)
+            keys[boid] = boid;
+    }
+    float cells_per_unit = (1u << LEVELS) / size;
+    uint last_cell = (1u << LEVELS) - 1;
+    pool.ParallelFor(num_boids, BUILD_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        for (uint i = begin; i < end; ++i)
+        {
+            uint boid = static_cast<uint>(keys[i] & BOID_MASK);
+            PE::Vec3 cell = (boids.GetPosition(boid) - low) * cells_per_unit;
+            std::uint64_t code = MortonCode(std::min(static_cast<uint>(cell.x), last_cell),
+                                            std::min(static_cast<uint>(cell.y), last_cell),
+                                            std::min(static_cast<uint>(cell.z), last_cell));
+            keys[i] = code << 32 | boid;
+        }
+    });
+    SortKeys();
+
+    points.resize(num_boids);
+    boid_points.resize(num_boids);
+    pool.ParallelFor(num_boids, BUILD_CHUNK_SIZE, [&](uint begin, uint end)
+    {
+        for (uint i = begin; i < end; ++i)
+        {
+            uint boid = static_cast<uint>(keys[i] & BOID_MASK);
+            points[i] = Point{boids.GetPosition(boid), boids.GetVelocity(boid)};
+            boid_points[boid] = i;
+        }
+    });
+
+    nodes.resize(1);
+    nodes[0].low = low;
+    nodes[0].size = size;
+    BuildNode(0, 0, num_boids, 0, false);
+}
+
+void Octree::SortKeys()
+{
+    // Few boids change cell between builds, so an insertion sort is close to one pass.
+    // Once it has moved keys further in total than that suggests, sort from scratch.
+    std::uint64_t budget = static_cast<std::uint64_t>(keys.size()) * INSERTION_SORT_BUDGET;
+    for (uint i = 1; i < keys.size(); ++i)
+    {
+        std::uint64_t key = keys[i];
+        uint slot = i;
+        while (slot > 0 && keys[slot - 1] > key)
+        {
+            keys[slot] = keys[slot - 1];
+            --slot;
+        }
+        keys[slot] = key;
+
+        budget -= std::min<std::uint64_t>(budget, i - slot);
+        if (budget == 0)
+        {
+            std::sort(keys.begin(), keys.end());
+            return;
+        }
+    }
+}
+
+void Octree::BuildNode(uint node, uint first, uint last, uint level, bool grouped)
+{
+    uint count = last - first;
+    if (!grouped && count <= GROUP_SIZE)
+    {
+        groups.emplace_back(Range{first, last});
+        grouped = true;
+    }
+    nodes[node].count = count;
+    nodes[node].num_children = 0;
+    if (count <= LEAF_SIZE || level == LEVELS)
+    {
+        PE::Vec3 position_sum{}, velocity_sum{};
+        for (uint i = first; i < last; ++i)
+        {
+            position_sum += points[i].position;
+            velocity_sum += points[i].velocity;
+        }
+        nodes[node].first = first;
+        nodes[node].center_of_mass = position_sum / static_cast<float>(count);
+        nodes[node].mean_velocity = velocity_sum / static_cast<float>(count);
+        return;
+    }
+
+    // Codes of a node's points agree down to its level, so each child's points
+    // are the run whose next three bits name that child's octant.
+    uint shift = 32 + 3 * (LEVELS - 1 - level);
+    uint bounds[9] = {};
+    for (uint i = first; i < last; ++i)
+        ++bounds[(keys[i] >> shift & 7) + 1];
+    bounds[0] = first;
+    for (uint octant = 0; octant < 8; ++octant)
+        bounds[octant + 1] += bounds[octant];
+
+    uint first_child = static_cast<uint>(nodes.size());
+    uint num_children = 0;
+    for (uint octant = 0; octant < 8; ++octant)
+        if (bounds[octant + 1] > bounds[octant])
+            ++num_children;
+    nodes.resize(first_child + num_children);
+    nodes[node].first = first_child;
+    nodes[node].num_children = num_children;
+
+    // Nodes grows as children are built, so only refer to them by index from here.
+    float half = nodes[node].size / 2;
+    uint child = first_child;
+    for (uint octant = 0; octant < 8; ++octant)
+    {
+        if (bounds[octant + 1] == bounds[octant])
+            continue;
+        PE::Vec3 corner{static_cast<float>(octant & 1), static_cast<float>(octant >> 1 & 1),
+                        static_cast<float>(octant >> 2 & 1)};
+        nodes[child].low = nodes[node].low + corner * half;
+        nodes[child].size = half;
+        BuildNode(child, bounds[octant], bounds[octant + 1], level + 1, grouped);
+        ++child;
+    }
+
+    PE::Vec3 position_sum{}, velocity_sum{};
+    for (child = first_child; child < first_child + num_children; ++child)
+    {
+        float weight = static_cast<float>(nodes[child].count);
+        position_sum += nodes[child].center_of_mass * weight;
+        velocity_sum += nodes[child].mean_velocity * weight;
+    }
+    nodes[node].center_of_mass = position_sum / static_cast<float>(count);
+    nodes[node].mean_velocity = velocity_sum / static_cast<float>(count);
+}
+
+void Octree::Gather(float radius, float opening_angle, const uint * boids, uint count)
+{
+    point_due.assign(points.size(), 0);
+    for (uint i = 0; i < count; ++i)
+        point_due[boid_points[boids[i]]] = 1;
+
+    sums.resize(points.size());
+    PE::ThreadPool::GetInstance().ParallelFor(static_cast<uint>(groups.size()), GATHER_CHUNK_SIZE,
+                                              [&](uint begin, uint end)
+    {
+        std::vector<FarNode> far_nodes;
+        std::vector<Range> near_leaves;
+        for (uint i = begin; i < end; ++i)
+            GatherGroup(groups[i], radius, opening_angle, far_nodes, near_leaves);
+    });
+}
+
+void Octree::GatherGroup(Range group, float radius, float opening_angle, std::vector<FarNode> & far_nodes,
+                         std::vector<Range> & near_leaves)
+{
+    float radius_squared = radius * radius;
+    float opening_squared = opening_angle * opening_angle;
+
+    // Box around the group's due boids. Shared sums are kept relative to its center, which is
+    // close to every boid in it, so offsets don't lose precision to large coordinates.
+    PE::Vec3 low{std::numeric_limits<float>::max()};
+    PE::Vec3 high{std::numeric_limits<float>::lowest()};
+    bool any_due = false;
+    for (uint i = group.first; i < group.last; ++i)
+    {
+        if (!point_due[i])
+            continue;
+        low = glm::min(low, points[i].position);
+        high = glm::max(high, points[i].position);
+        any_due = true;
+    }
+    if (!any_due)
+        return;
+    PE::Vec3 center = (low + high) / 2.f;
+
+    // Sort the tree into nodes in range of every boid in the box, shared by all of them, nodes
+    // to weigh per boid, and points to check per boid. Nodes out of range of all of them drop out.
+    PE::Vec3 shared_offset{}, shared_velocity{};
+    float shared_weight = 0;
+    auto share = [&](const Node & node)
+    {
+        float weight = static_cast<float>(node.count);
+        shared_offset += (node.center_of_mass - center) * weight;
+        shared_velocity += node.mean_velocity * weight;
+        shared_weight += weight;
+    };
+    far_nodes.clear();
+    near_leaves.clear();
+    uint stack[GATHER_STACK_SIZE];
+    uint depth = 0;
+    stack[depth++] = 0;
+    while (depth)
+    {
+        uint index = stack[--depth];
+        const Node & node = nodes[index];
+        PE::Vec3 node_high = node.low + node.size;
+        PE::Vec3 gap = glm::max(glm::max(node.low - high, low - node_high), PE::Vec3{0});
+        float gap_squared = glm::dot(gap, gap);
+        if (gap_squared >= radius_squared)
+            continue;
+        PE::Vec3 span = glm::max(glm::abs(node_high - low), glm::abs(high - node.low));
+        if (glm::dot(span, span) < radius_squared)
+        {
+            share(node);
+            continue;
+        }
+
+        // The radius cuts through the node for some of the boids. If it looks small enough
+        // from all of them, each weighs it by where its center of mass is. Nodes touching the
+        // box are always opened, so every boid finds itself exactly once.
+        float slack = node.size * INSIDE_SLACK;
+        PE::Vec3 to_center = glm::max(glm::max(low - node.center_of_mass, node.center_of_mass - high), PE::Vec3{0});
+        float center_squared = glm::dot(to_center, to_center);
+        if (gap_squared > slack * slack && node.size * node.size < opening_squared * center_squared)
+        {
+            // Where every boid would weigh it fully, or not at all, that is settled here.
+            float full = radius - node.size / 2;
+            float none = radius + node.size / 2;
+            PE::Vec3 to_far = glm::max(glm::abs(node.center_of_mass - low), glm::abs(node.center_of_mass - high));
+            if (center_squared >= none * none)
+                continue;
+            if (full > 0 && glm::dot(to_far, to_far) <= full * full)
+                share(node);
+            else
+                far_nodes.emplace_back(FarNode{node.center_of_mass, node.mean_velocity,
+                                               static_cast<float>(node.count), 1 / node.size});
+            continue;
+        }
+
+        if (node.num_children == 0)
+        {
+            near_leaves.emplace_back(Range{node.first, node.first + node.count});
+            continue;
+        }
+        for (uint child = node.first; child < node.first + node.num_children; ++child)
+            stack[depth++] = child;
+    }
+
+    for (uint i = group.first; i < group.last; ++i)
+    {
+        if (!point_due[i])
+            continue;
+        PE::Vec3 position = points[i].position;
+        FlockSums boid_sums{shared_offset - (position - center) * shared_weight, shared_velocity, shared_weight};
+
+        // About how much of each far node lies within the radius, going by its center of mass.
+        for (const FarNode & far : far_nodes)
+        {
+            PE::Vec3 offset = far.center_of_mass - position;
+            float inside = 0.5f + (radius - glm::length(offset)) * far.inverse_size;
+            float weight = std::clamp(inside, 0.f, 1.f) * far.count;
+            boid_sums.offset += offset * weight;
+            boid_sums.velocity += far.mean_velocity * weight;
+            boid_sums.weight += weight;
+        }
+        for (Range leaf : near_leaves)
+            for (uint point = leaf.first; point < leaf.last; ++point)
+            {
+                PE::Vec3 offset = points[point].position - position;
+                float weight = glm::dot(offset, offset) < radius_squared ? 1.f : 0.f;
+                boid_sums.offset += offset * weight;
+                boid_sums.velocity += points[point].velocity * weight;
+                boid_sums.weight += weight;
+            }
+        sums[keys[i] & BOID_MASK] = boid_sums;
+    }
+}
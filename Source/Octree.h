@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Engine/Types.h"
+#include "BoidStorage.h"
+
+// Totals over the boids a long range query reached, each weighed by how surely it is in range.
+struct FlockSums
+{
+    // Sum of the offsets from the query position to each boid.
+    PE::Vec3 offset{};
+    PE::Vec3 velocity{};
+    // Number of boids counted, fractional where part of a node was.
+    float weight = 0;
+};
+
+/*!
+@brief Octree over boid positions that keeps the center of mass and mean
+   velocity of every node, for cohesion and alignment over a radius far
+   larger than the neighbor lists cover. Offsets and velocities add up
+   linearly, so a node wholly in range counts as one entry without any
+   error, and only nodes the radius cuts through have to be opened. Those
+   that look small enough, as set by the opening angle, count as their
+   center of mass, weighed by roughly how much of the node lies in range.
+   Boids are sorted by their Morton code within the bounds of the flock,
+   so every node is a run of consecutive points. Boids walk the tree in
+   small groups: what is in range of a whole group is summed once, and each
+   boid only goes through the nodes and points near its own radius.
+*/
+class Octree
+{
+public:
+    // Rebuilds the tree from the boids' current positions and velocities.
+    void Build(const BoidStorage & boids);
+
+    /*!
+    @brief Sums the offsets and velocities of the boids within radius of
+       each of the given boids, each including the boid itself. Each group walks
+       the tree around only its given boids, groups with none skip it, and
+       every other boid keeps the sums it had.
+    @param opening_angle Largest node size over distance that is weighed
+       as a whole where the radius cuts through it. 0 opens every such node
+       for an exact answer.
+    */
+    void Gather(float radius, float opening_angle, const uint * boids, uint count);
+
+    // A boid's sums from the last Gather that reached it.
+    [[nodiscard]] const FlockSums & GetSums(uint boid) const
+    { return sums[boid]; }
+
+private:
+    struct Point
+    {
+        PE::Vec3 position;
+        PE::Vec3 velocity;
+    };
+
+    struct Range
+    {
+        uint first;
+        uint last;
+    };
+
+    struct Node
+    {
+        PE::Vec3 low;
+        float size;
+        PE::Vec3 center_of_mass;
+        PE::Vec3 mean_velocity;
+        uint count;
+        // First point for a leaf, first child otherwise. Children are stored together.
+        uint first;
+        // 0 for a leaf.
+        uint num_children;
+    };
+
+    // A node some of a group's boids weigh by how much of it is in their range.
+    struct FarNode
+    {
+        PE::Vec3 center_of_mass;
+        PE::Vec3 mean_velocity;
+        float count;
+        float inverse_size;
+    };
+
+    void SortKeys();
+
+    // Fills in node and everything below it from the points in [first, last),
+    // and records the first node on each path small enough to be a group.
+    void BuildNode(uint node, uint first, uint last, uint level, bool grouped);
+
+    // Fills in the sums of the due boids in group, using the lists as scratch.
+    void GatherGroup(Range group, float radius, float opening_angle, std::vector<FarNode> & far_nodes,
+                     std::vector<Range> & near_leaves);
+
+    // Morton code and boid index of each point, sorted.
+    std::vector<std::uint64_t> keys;
+    std::vector<Point> points;
+    std::vector<Node> nodes;
+    // Points of each group, together covering every point.
+    std::vector<Range> groups;
+    // Point of each boid, by boid index.
+    std::vector<uint> boid_points;
+    // Whether each point's boid was passed to the current Gather.
+    std::vector<std::uint8_t> point_due;
+
+    // By boid index.
+    std::vector<FlockSums> sums;
+};
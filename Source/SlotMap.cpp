@@ -0,0 +1,55 @@
+#include "SlotMap.h"
+
+BoidHandle SlotMap::Add()
+{
+    uint slot;
+    if (free_slots.empty())
+    {
+        slot = static_cast<uint>(slots.size());
+        slots.emplace_back(Slot{0, 0});
+    }
+    else
+    {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    }
+
+    // The index may have been vacated by an earlier removal, so it counts as changing hands now.
+    slots[slot].index = Size();
+    slot_of.emplace_back(slot);
+    arrival.emplace_back(epoch);
+    return BoidHandle{slot, slots[slot].generation};
+}
+
+void SlotMap::SwapRemove(uint index)
+{
+    uint last = Size() - 1;
+    uint removed_slot = slot_of[index];
+    slots[removed_slot].index = NO_BOID;
+    ++slots[removed_slot].generation;
+    free_slots.emplace_back(removed_slot);
+    ++epoch;
+
+    if (index != last)
+    {
+        slot_of[index] = slot_of[last];
+        slots[slot_of[index]].index = index;
+        arrival[index] = epoch;
+    }
+    slot_of.pop_back();
+    arrival.pop_back();
+}
+
+void SlotMap::Permute(const std::vector<uint> & order)
+{
+    std::vector<uint> new_slot_of(order.size());
+    std::vector<uint> new_arrival(order.size());
+    for (uint i = 0; i < order.size(); ++i)
+    {
+        new_slot_of[i] = slot_of[order[i]];
+        new_arrival[i] = arrival[order[i]];
+        slots[new_slot_of[i]].index = i;
+    }
+    slot_of.swap(new_slot_of);
+    arrival.swap(new_arrival);
+}
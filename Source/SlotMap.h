@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include "Engine/Types.h"
+
+// Index Find returns for a handle whose boid has been removed.
+const uint NO_BOID = ~0u;
+
+// Names one boid for as long as it lives, however often its index changes.
+struct BoidHandle
+{
+    uint slot = NO_BOID;
+    uint generation = 0;
+
+    bool operator==(const BoidHandle & other) const
+    { return slot == other.slot && generation == other.generation; }
+
+    bool operator!=(const BoidHandle & other) const
+    { return !(*this == other); }
+};
+
+/*!
+@brief Maps stable boid handles to the boids' current indices, for arrays
+   kept dense by moving the last boid into each removed one's place. A
+   handle names a slot holding the boid's index, and a generation that is
+   bumped when the boid is removed, so a stale handle finds nothing rather
+   than whichever boid took its place. Slots of removed boids are reused.
+
+   Every removal also advances an epoch, and each index is stamped with the
+   epoch its boid arrived at, so a list of indices gathered at some epoch
+   can tell which of its entries have since changed hands.
+*/
+class SlotMap
+{
+public:
+    [[nodiscard]] uint Size() const
+    { return static_cast<uint>(slot_of.size()); }
+
+    // Gives the boid just appended after the last index a new handle.
+    BoidHandle Add();
+
+    // Frees the handle of the boid at index and moves the last boid into its place.
+    void SwapRemove(uint index);
+
+    // Reorders indices so the boid at order[i] moves to index i.
+    void Permute(const std::vector<uint> & order);
+
+    // Current index of the handle's boid, or NO_BOID if it has been removed.
+    [[nodiscard]] uint Find(BoidHandle handle) const
+    {
+        if (handle.slot >= slots.size() || slots[handle.slot].generation != handle.generation)
+            return NO_BOID;
+        return slots[handle.slot].index;
+    }
+
+    [[nodiscard]] BoidHandle GetHandle(uint index) const
+    { return BoidHandle{slot_of[index], slots[slot_of[index]].generation}; }
+
+    [[nodiscard]] uint GetEpoch() const
+    { return epoch; }
+
+    // Whether index still holds the boid it held at epoch since.
+    [[nodiscard]] bool SameBoid(uint index, uint since) const
+    { return index < Size() && arrival[index] <= since; }
+
+private:
+    struct Slot
+    {
+        uint index;
+        uint generation;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint> free_slots;
+
+    // Slot and arrival epoch of the boid at each index.
+    std::vector<uint> slot_of;
+    std::vector<uint> arrival;
+
+    uint epoch = 0;
+};
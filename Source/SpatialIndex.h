@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "Engine/Types.h"
+#include "IndexSpan.h"
+
+// Identifies one cell of a spatial index.
+using CellKey = std::uint64_t;
+
+/*!
+@brief Interface for the spatial partitions boids use to find neighbors.
+   Boids are filed by cell key, and a lookup returns the runs of boid
+   indices stored in the cells around a position.
+*/
+class SpatialIndex
+{
+public:
+    virtual ~SpatialIndex() = default;
+    
+    // Key of the cell containing the position.
+    [[nodiscard]] virtual CellKey GetKey(const PE::Vec3 & position) const = 0;
+    
+    // Rebuild from one cell key per boid.
+    virtual void Build(const CellKey * keys, uint count) = 0;
+    
+    // Files boids first through first + count - 1, which must be the last boids
+    // in keys, without touching the boids already in the index.
+    virtual void Insert(const CellKey * keys, uint first, uint count) = 0;
+    
+    // Refiles boid from the cell of key from to the cell of key to.
+    virtual void Move(uint boid, CellKey from, CellKey to) = 0;
+    
+    // Takes out boid, filed under key, and refiles the last boid under boid's
+    // index, matching a swap-and-pop of the boid arrays.
+    virtual void SwapRemove(uint boid, CellKey key) = 0;
+    virtual void Clear() = 0;
+    
+    // Appends the contents of every cell within reach cells of the position's cell.
+    virtual void GatherCells(const PE::Vec3 & position, uint reach, std::vector<IndexSpan> & cells) const = 0;
+    
+    // Every boid in the index as a single run.
+    [[nodiscard]] virtual IndexSpan GetAll() const = 0;
+    
+    /*!
+    @brief Appends the contents of every cell that could hold a boid within
+       radius of the position. Boids still need their distance checked.
+       When the radius spans more cells than there are boids, it's cheaper to
+       check them all, so every boid is returned instead.
+    */
+    void GatherRadius(const PE::Vec3 & position, float radius, std::vector<IndexSpan> & cells) const
+    {
+        IndexSpan all = GetAll();
+        if (all.empty())
+            return;
+        
+        float reach = std::ceil(radius / GetCellSize());
+        float side = reach * 2 + 1;
+        if (side * side * side > all.size())
+            cells.emplace_back(all);
+        else
+            GatherCells(position, static_cast<uint>(reach), cells);
+    }
+    
+    [[nodiscard]] virtual float GetCellSize() const = 0;
+};